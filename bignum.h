@@ -0,0 +1,239 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "utils.h"
+
+// Natural numbers of any size as little endian 64 bit limbs. A Big never has a
+// leading zero limb, so zero has no limbs at all.
+
+typedef unsigned __int128 uint128_t;
+
+#define KARATSUBA_THRESHOLD 32
+
+typedef struct Big{
+	size_t size;
+	uint64_t *limbs;
+} Big;
+
+static uint64_t *limbs_alloc(size_t size){
+	uint64_t *res = malloc((size ? size : 1) * sizeof(uint64_t));
+	if (res == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	return res;
+}
+
+static Big big_trim(Big x){
+	while (x.size != 0 && x.limbs[x.size-1] == 0) x.size -= 1;
+	return x;
+}
+
+// dst += src, the carry runs up to the end of dst
+static void limbs_add(uint64_t *dst, size_t dst_size, const uint64_t *src, size_t src_size){
+	uint64_t carry = 0;
+	size_t i = 0;
+	for (; i!=src_size; i+=1){
+		uint128_t t = (uint128_t)dst[i] + src[i] + carry;
+		dst[i] = (uint64_t)t;
+		carry = (uint64_t)(t >> 64);
+	}
+	for (; carry!=0 && i!=dst_size; i+=1){
+		dst[i] += 1;
+		carry = dst[i] == 0;
+	}
+}
+
+// dst -= src, which must not go below zero
+static void limbs_sub(uint64_t *dst, size_t dst_size, const uint64_t *src, size_t src_size){
+	uint64_t borrow = 0;
+	size_t i = 0;
+	for (; i!=src_size; i+=1){
+		uint64_t s = src[i] + borrow;
+		borrow = (s < borrow) | (dst[i] < s);
+		dst[i] -= s;
+	}
+	for (; borrow!=0 && i!=dst_size; i+=1){
+		borrow = dst[i] == 0;
+		dst[i] -= 1;
+	}
+}
+
+static void limbs_mul_school(uint64_t *res, const uint64_t *a, size_t a_size, const uint64_t *b, size_t b_size){
+	memset(res, 0, (a_size + b_size) * sizeof(uint64_t));
+	for (size_t i=0; i!=a_size; i+=1){
+		uint64_t carry = 0;
+		for (size_t j=0; j!=b_size; j+=1){
+			uint128_t t = (uint128_t)a[i]*b[j] + res[i+j] + carry;
+			res[i+j] = (uint64_t)t;
+			carry = (uint64_t)(t >> 64);
+		}
+		res[i+b_size] = carry;
+	}
+}
+
+// res[0, a_size+b_size) = a*b, res must not overlap the operands. Operands of
+// very different sizes are cut into pieces the size of the shorter one, then
+// each product of similar sizes is split in halves with Karatsuba's three
+// multiplications instead of four.
+static void limbs_mul(uint64_t *res, const uint64_t *a, size_t a_size, const uint64_t *b, size_t b_size){
+	if (a_size < b_size){
+		const uint64_t *t = a;
+		a = b;
+		b = t;
+		size_t s = a_size;
+		a_size = b_size;
+		b_size = s;
+	}
+	if (b_size < KARATSUBA_THRESHOLD){
+		limbs_mul_school(res, a, a_size, b, b_size);
+		return;
+	}
+	if (a_size >= 2*b_size){
+		memset(res, 0, (a_size + b_size) * sizeof(uint64_t));
+		uint64_t *part = limbs_alloc(2*b_size);
+		for (size_t offset=0; offset<a_size; offset+=b_size){
+			size_t size = a_size - offset < b_size ? a_size - offset : b_size;
+			limbs_mul(part, a + offset, size, b, b_size);
+			limbs_add(res + offset, a_size + b_size - offset, part, size + b_size);
+		}
+		free(part);
+		return;
+	}
+
+	size_t half = b_size / 2;
+	size_t a1_size = a_size - half;
+	size_t b1_size = b_size - half;
+	limbs_mul(res, a, half, b, half);
+	limbs_mul(res + 2*half, a + half, a1_size, b + half, b1_size);
+
+	uint64_t *sums = limbs_alloc(a1_size+1 + b1_size+1);
+	uint64_t *sa = sums;
+	uint64_t *sb = sums + a1_size+1;
+	memcpy(sa, a + half, a1_size * sizeof(uint64_t));
+	sa[a1_size] = 0;
+	limbs_add(sa, a1_size+1, a, half);
+	memcpy(sb, b + half, b1_size * sizeof(uint64_t));
+	sb[b1_size] = 0;
+	limbs_add(sb, b1_size+1, b, half);
+
+	size_t middle_size = a1_size+1 + b1_size+1;
+	uint64_t *middle = limbs_alloc(middle_size);
+	limbs_mul(middle, sa, a1_size+1, sb, b1_size+1);
+	limbs_sub(middle, middle_size, res, 2*half);
+	limbs_sub(middle, middle_size, res + 2*half, a1_size + b1_size);
+	while (middle_size != 0 && middle[middle_size-1] == 0) middle_size -= 1;
+	limbs_add(res + half, a_size + b_size - half, middle, middle_size);
+	free(middle);
+	free(sums);
+}
+
+static Big big_mul(Big a, Big b){
+	if (a.size == 0 || b.size == 0) return (Big){0, limbs_alloc(0)};
+	Big res = {a.size + b.size, limbs_alloc(a.size + b.size)};
+	limbs_mul(res.limbs, a.limbs, a.size, b.limbs, b.size);
+	return big_trim(res);
+}
+
+// product of numbers that fit in a limb, multiplied as a balanced tree so that
+// the big multiplications get operands of equal size
+static Big big_product(const uint64_t *words, size_t count){
+	if (count <= KARATSUBA_THRESHOLD){
+		Big res = {1, limbs_alloc(count + 1)};
+		res.limbs[0] = 1;
+		for (size_t i=0; i!=count; i+=1){
+			uint64_t carry = 0;
+			for (size_t j=0; j!=res.size; j+=1){
+				uint128_t t = (uint128_t)res.limbs[j]*words[i] + carry;
+				res.limbs[j] = (uint64_t)t;
+				carry = (uint64_t)(t >> 64);
+			}
+			if (carry != 0) res.limbs[res.size++] = carry;
+		}
+		return big_trim(res);
+	}
+	Big low = big_product(words, count/2);
+	Big high = big_product(words + count/2, count - count/2);
+	Big res = big_mul(low, high);
+	free(low.limbs);
+	free(high.limbs);
+	return res;
+}
+
+static uint64_t big_mod_u64(Big x, uint64_t m){
+	uint64_t res = 0;
+	for (size_t i=x.size; i!=0; i-=1) res = (uint64_t)((((uint128_t)res << 64) | x.limbs[i-1]) % m);
+	return res;
+}
+
+static double big_to_double(Big x){
+	if (x.size == 0) return 0.0;
+	if (x.size == 1) return (double)x.limbs[0];
+	double top = (double)x.limbs[x.size-1] * 0x1p64 + (double)x.limbs[x.size-2];
+	return ldexp(top, 64 * (int)(x.size - 2));
+}
+
+// decimal digits, divided off nineteen at a time from the top down
+static char *big_to_decimal(Big x){
+	uint64_t *limbs = limbs_alloc(x.size);
+	memcpy(limbs, x.limbs, x.size * sizeof(uint64_t));
+	size_t size = x.size;
+	size_t capacity = 20 * x.size + 2;
+	char *digits = malloc(capacity);
+	if (digits == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	size_t count = 0;
+	do{
+		uint64_t rem = 0;
+		for (size_t i=size; i!=0; i-=1){
+			uint128_t t = ((uint128_t)rem << 64) | limbs[i-1];
+			limbs[i-1] = (uint64_t)(t / 10000000000000000000ull);
+			rem = (uint64_t)(t % 10000000000000000000ull);
+		}
+		while (size != 0 && limbs[size-1] == 0) size -= 1;
+		for (int i=0; i!=19 && (size != 0 || rem != 0 || i == 0); i+=1){
+			digits[count++] = '0' + rem % 10;
+			rem /= 10;
+		}
+	} while (size != 0);
+	for (size_t i=0; i!=count/2; i+=1){
+		char t = digits[i];
+		digits[i] = digits[count-1-i];
+		digits[count-1-i] = t;
+	}
+	digits[count] = '\0';
+	free(limbs);
+	return digits;
+}
+
+static void big_mul_word(Big *x, uint64_t w){
+	uint64_t carry = 0;
+	for (size_t i=0; i!=x->size; i+=1){
+		uint128_t t = (uint128_t)x->limbs[i]*w + carry;
+		x->limbs[i] = (uint64_t)t;
+		carry = (uint64_t)(t >> 64);
+	}
+	if (carry == 0) return;
+	x->limbs = realloc(x->limbs, (x->size + 1) * sizeof(uint64_t));
+	if (x->limbs == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	x->limbs[x->size] = carry;
+	x->size += 1;
+}
+
+// the remainder is dropped, callers divide by known divisors
+static void big_div_word(Big *x, uint64_t w){
+	uint64_t rem = 0;
+	for (size_t i=x->size; i!=0; i-=1){
+		uint128_t t = ((uint128_t)rem << 64) | x->limbs[i-1];
+		x->limbs[i-1] = (uint64_t)(t / w);
+		rem = (uint64_t)(t % w);
+	}
+	*x = big_trim(*x);
+}
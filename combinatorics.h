@@ -0,0 +1,166 @@
+#pragma once
+
+#include "utils.h"
+#include "primes.h"
+#include "modular.h"
+#include "bignum.h"
+
+// Ratios top!/(b1! b2! ...) of factorials, which covers binomials, permutations
+// and multinomials, either exactly or modulo any number. The exponent of every
+// prime in the ratio comes from Legendre's formula, so nothing is ever divided.
+
+static uint64_t legendre(uint64_t n, uint64_t p){
+	uint64_t res = 0;
+	while (n != 0){
+		n /= p;
+		res += n;
+	}
+	return res;
+}
+
+static uint64_t ratio_exponent(uint64_t p, uint64_t top, const uint64_t *bottoms, size_t bottom_count){
+	uint64_t res = legendre(top, p);
+	for (size_t i=0; i!=bottom_count; i+=1) res -= legendre(bottoms[i], p);
+	return res;
+}
+
+// primes up to limit, 2 included
+static uint32_t *primes_up_to(uint64_t limit, size_t *count){
+	uint32_t *odd = small_sieve(limit < 3 ? 3 : limit, count);
+	uint32_t *res = malloc((*count + 1) * sizeof(uint32_t));
+	if (res == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	res[0] = 2;
+	size_t n = 1;
+	for (size_t i=0; i!=*count && odd[i]<=limit; i+=1) res[n++] = odd[i];
+	*count = limit < 2 ? 0 : n;
+	free(odd);
+	return res;
+}
+
+// prime powers are packed into as few limbs as fit before the product tree
+static Big factorial_ratio(uint64_t top, const uint64_t *bottoms, size_t bottom_count){
+	size_t prime_count;
+	uint32_t *primes = primes_up_to(top, &prime_count);
+	size_t word_count = 0;
+	size_t word_capacity = 64;
+	uint64_t *words = limbs_alloc(word_capacity);
+	uint64_t word = 1;
+	for (size_t i=0; i!=prime_count; i+=1){
+		uint64_t p = primes[i];
+		for (uint64_t e=ratio_exponent(p, top, bottoms, bottom_count); e!=0; e-=1){
+			if (word > UINT64_MAX / p){
+				if (word_count == word_capacity){
+					word_capacity *= 2;
+					words = realloc(words, word_capacity * sizeof(uint64_t));
+					if (words == NULL){
+						fprintf(stderr, "ERROR: out of memory\n");
+						exit(1);
+					}
+				}
+				words[word_count++] = word;
+				word = 1;
+			}
+			word *= p;
+		}
+	}
+	if (word_count == word_capacity) words = realloc(words, (word_capacity + 1) * sizeof(uint64_t));
+	words[word_count++] = word;
+	Big res = big_product(words, word_count);
+	free(words);
+	free(primes);
+	return res;
+}
+
+static uint64_t factorial_ratio_mod(const Modulus *m, uint64_t top, const uint64_t *bottoms, size_t bottom_count){
+	size_t prime_count;
+	uint32_t *primes = primes_up_to(top, &prime_count);
+	uint64_t res = 1 % m->n;
+	for (size_t i=0; i!=prime_count; i+=1){
+		uint64_t e = ratio_exponent(primes[i], top, bottoms, bottom_count);
+		if (e != 0) res = mod_mul(m, res, mod_pow(m, primes[i] % m->n, e));
+	}
+	free(primes);
+	return res;
+}
+
+
+// n! and 1/n! modulo a prime for every n below size, grown on demand and kept
+// between calls, so a binomial is three lookups and two multiplications
+typedef struct FactorialTable{
+	size_t size;
+	uint64_t *factorials;
+	uint64_t *inverses;
+} FactorialTable;
+
+// size must not exceed the modulus, which has to be prime
+static void factorial_table_reserve(FactorialTable *t, const Modulus *m, size_t size){
+	if (size <= t->size) return;
+	if (size < 2*t->size) size = 2*t->size < m->n ? 2*t->size : m->n;
+	t->factorials = realloc(t->factorials, size * sizeof(uint64_t));
+	t->inverses = realloc(t->inverses, size * sizeof(uint64_t));
+	if (t->factorials == NULL || t->inverses == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	t->factorials[0] = 1 % m->n;
+	for (size_t i=t->size ? t->size : 1; i!=size; i+=1) t->factorials[i] = mod_mul(m, t->factorials[i-1], i);
+	mod_inverse(m, t->factorials[size-1], t->inverses + size-1);
+	for (size_t i=size-1; i!=0; i-=1) t->inverses[i-1] = mod_mul(m, t->inverses[i], i);
+	t->size = size;
+}
+
+// Lucas' theorem: the binomial modulo a prime p is the product of the binomials
+// of the base p digits, which all fall inside the table
+static uint64_t binomial_lucas(const FactorialTable *t, const Modulus *m, uint64_t n, uint64_t k){
+	uint64_t res = 1 % m->n;
+	while (k != 0){
+		uint64_t nd = n % m->n;
+		uint64_t kd = k % m->n;
+		if (kd > nd) return 0;
+		res = mod_mul(m, res, mod_mul(m, t->factorials[nd], mod_mul(m, t->inverses[kd], t->inverses[nd-kd])));
+		n /= m->n;
+		k /= m->n;
+	}
+	return res;
+}
+
+// Lucas' theorem for primes too large for a table. A digit binomial C(nd, kd)
+// with r = min(kd, nd-kd) is the product of the top r factors of nd! over r!,
+// or nd!/(kd! (nd-kd)!) when r is large, the factorials run on all threads.
+// False when a digit needs more than BINOMIAL_PRIME_MAX_TERMS multiplications
+// one way and a factorial above BINOMIAL_PRIME_MAX_FACTORIAL the other.
+#define BINOMIAL_PRIME_MAX_TERMS (1 << 27)
+#define BINOMIAL_PRIME_MAX_FACTORIAL (1ull << 31)
+
+static bool binomial_prime(const Modulus *m, uint64_t n, uint64_t k, uint64_t *res){
+	*res = 1 % m->n;
+	while (k != 0){
+		uint64_t nd = n % m->n;
+		uint64_t kd = k % m->n;
+		if (kd > nd){
+			*res = 0;
+			return true;
+		}
+		uint64_t r = kd < nd-kd ? kd : nd-kd;
+		uint64_t top, bottom;
+		if (r <= BINOMIAL_PRIME_MAX_TERMS){
+			top = 1 % m->n;
+			for (uint64_t i=0; i!=r; i+=1) top = mod_mul(m, top, nd - i);
+			bottom = mod_factorial(m, r);
+		} else if (nd <= BINOMIAL_PRIME_MAX_FACTORIAL){
+			top = mod_factorial(m, nd);
+			bottom = mod_mul(m, mod_factorial(m, kd), mod_factorial(m, nd-kd));
+		} else{
+			return false;
+		}
+		uint64_t inverse;
+		if (!mod_inverse(m, bottom, &inverse)) return false;
+		*res = mod_mul(m, *res, mod_mul(m, top, inverse));
+		n /= m->n;
+		k /= m->n;
+	}
+	return true;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "parallel.h"
+
+// Numeric CSV files, mapped into memory and parsed on all threads. Fields are
+// separated by commas and an optional first line names the columns. The file
+// is cut into chunks at line starts, the rows of every chunk are counted in a
+// first pass so that each chunk knows where its rows go in the second one.
+
+#define CSV_MAX_COLUMNS 16
+#define CSV_NAME_CAPACITY 64
+#define CSV_FIELD_CAPACITY 64
+#define CSV_CHUNK (1 << 20)
+
+// columns[c][row], all columns are one allocation starting at columns[0]
+typedef struct Dataset{
+	size_t row_count;
+	size_t column_count;
+	bool has_names;
+	char names[CSV_MAX_COLUMNS][CSV_NAME_CAPACITY + 1];
+	double *columns[CSV_MAX_COLUMNS];
+} Dataset;
+
+typedef struct CsvParse{
+	const char *text;
+	size_t size;
+	size_t begin;
+	size_t chunk_count;
+	size_t *rows;
+	size_t *bad_rows;
+	Dataset *data;
+} CsvParse;
+
+static bool csv_blank(const char *line, const char *end){
+	for (; line!=end; line+=1){
+		if (*line != ' ' && *line != '\t' && *line != '\r') return false;
+	}
+	return true;
+}
+
+static const char *csv_line_end(const CsvParse *p, const char *line){
+	const char *end = memchr(line, '\n', p->text + p->size - line);
+	return end ? end : p->text + p->size;
+}
+
+// a chunk owns the lines that start inside it
+static const char *csv_chunk_start(const CsvParse *p, size_t index){
+	size_t offset = p->begin + index * (size_t)CSV_CHUNK;
+	if (offset >= p->size) return p->text + p->size;
+	if (index != 0){
+		while (offset < p->size && p->text[offset-1] != '\n') offset += 1;
+	}
+	return p->text + offset;
+}
+
+// fields are copied out before strtod, the mapping has no terminating zero
+static size_t csv_fields(const char *line, const char *end, double *values, size_t capacity, bool *ok){
+	size_t count = 0;
+	*ok = true;
+	for (;;){
+		const char *field_end = memchr(line, ',', end - line);
+		if (field_end == NULL) field_end = end;
+		char field[CSV_FIELD_CAPACITY + 1];
+		size_t size = field_end - line;
+		if (size > CSV_FIELD_CAPACITY) size = CSV_FIELD_CAPACITY;
+		memcpy(field, line, size);
+		field[size] = '\0';
+		char *rest;
+		double value = strtod(field, &rest);
+		if (rest == field || !csv_blank(rest, field + size)) *ok = false;
+		if (count != capacity) values[count] = value;
+		count += 1;
+		if (field_end == end) return count;
+		line = field_end + 1;
+	}
+}
+
+static void csv_count_task(size_t index, void *data){
+	CsvParse *p = data;
+	const char *end = csv_chunk_start(p, index + 1);
+	size_t rows = 0;
+	for (const char *line=csv_chunk_start(p, index); line<end;){
+		const char *line_end = csv_line_end(p, line);
+		rows += !csv_blank(line, line_end);
+		line = line_end + 1;
+	}
+	p->rows[index] = rows;
+}
+
+static void csv_parse_task(size_t index, void *data){
+	CsvParse *p = data;
+	Dataset *d = p->data;
+	const char *end = csv_chunk_start(p, index + 1);
+	size_t row = p->rows[index];
+	p->bad_rows[index] = SIZE_MAX;
+	for (const char *line=csv_chunk_start(p, index); line<end;){
+		const char *line_end = csv_line_end(p, line);
+		if (!csv_blank(line, line_end)){
+			double values[CSV_MAX_COLUMNS];
+			bool ok;
+			size_t count = csv_fields(line, line_end, values, CSV_MAX_COLUMNS, &ok);
+			if ((!ok || count != d->column_count) && p->bad_rows[index] == SIZE_MAX) p->bad_rows[index] = row;
+			for (size_t c=0; c!=d->column_count; c+=1) d->columns[c][row] = c < count ? values[c] : NAN;
+			row += 1;
+		}
+		line = line_end + 1;
+	}
+}
+
+// a first line that is not all numbers holds the names of the columns
+static const char *csv_header(CsvParse *p){
+	Dataset *d = p->data;
+	const char *line = p->text;
+	const char *line_end;
+	for (;; line=line_end+1){
+		if (line >= p->text + p->size) return "file has no data";
+		line_end = csv_line_end(p, line);
+		if (!csv_blank(line, line_end)) break;
+	}
+	double values[CSV_MAX_COLUMNS];
+	bool ok;
+	d->column_count = csv_fields(line, line_end, values, CSV_MAX_COLUMNS, &ok);
+	if (d->column_count > CSV_MAX_COLUMNS) return "too many columns";
+	p->begin = line - p->text;
+	d->has_names = !ok;
+	if (ok) return NULL;
+
+	for (size_t c=0; c!=d->column_count; c+=1){
+		while (*line == ' ' || *line == '\t') line += 1;
+		const char *name = line;
+		while (line != line_end && *line != ',') line += 1;
+		const char *name_end = line;
+		while (name_end != name && (name_end[-1] == ' ' || name_end[-1] == '\t' || name_end[-1] == '\r')) name_end -= 1;
+		if (name_end - name > CSV_NAME_CAPACITY) return "column name too long";
+		memcpy(d->names[c], name, name_end - name);
+		d->names[c][name_end - name] = '\0';
+		line += 1;
+	}
+	p->begin = line_end - p->text + 1;
+	return NULL;
+}
+
+// returns an error message or NULL, the columns are malloced
+static const char *csv_load(const char *path, Dataset *d){
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return "cannot open file";
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0){
+		close(fd);
+		return "file is empty";
+	}
+	const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (text == MAP_FAILED) return "cannot map file";
+
+	CsvParse p = {.text = text, .size = st.st_size, .data = d};
+	const char *error = csv_header(&p);
+	if (error == NULL){
+		p.chunk_count = p.begin < p.size ? (p.size - p.begin + CSV_CHUNK-1) / CSV_CHUNK : 0;
+		p.rows = malloc((2*p.chunk_count + 1) * sizeof(size_t));
+		if (p.rows == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+		p.bad_rows = p.rows + p.chunk_count;
+		parallel_for(p.chunk_count, csv_count_task, &p);
+		d->row_count = 0;
+		for (size_t i=0; i!=p.chunk_count; i+=1){
+			size_t rows = p.rows[i];
+			p.rows[i] = d->row_count;
+			d->row_count += rows;
+		}
+		d->columns[0] = malloc((d->row_count * d->column_count + 1) * sizeof(double));
+		if (d->columns[0] == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+		for (size_t c=1; c!=d->column_count; c+=1) d->columns[c] = d->columns[c-1] + d->row_count;
+		parallel_for(p.chunk_count, csv_parse_task, &p);
+		for (size_t i=0; i!=p.chunk_count; i+=1){
+			if (p.bad_rows[i] != SIZE_MAX){
+				error = "malformed row";
+				free(d->columns[0]);
+				break;
+			}
+		}
+		if (error == NULL && d->row_count == 0){
+			error = "file has no data";
+			free(d->columns[0]);
+		}
+		free(p.rows);
+	}
+	munmap((void *)text, st.st_size);
+	return error;
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "utils.h"
+
+// Decimal floating point with the 16 digit coefficient and the exponent range
+// of decimal64. The coefficient is a binary integer like in the BID encoding,
+// kept next to its exponent instead of packed into one word. Every result is
+// computed exactly in 128 bits, or with a sticky digit below the digits that
+// are kept, and rounded once, so + - * / are correctly rounded in every
+// rounding mode and 0.1 + 0.2 is 0.3.
+
+#define DECIMAL_DIGITS 16
+#define DECIMAL_MIN_EXPONENT -398
+#define DECIMAL_MAX_EXPONENT 369
+#define DECIMAL_WIDE_DIGITS 38
+#define DECIMAL_TEXT_CAPACITY 48
+
+typedef uint8_t DecimalRounding;
+enum DecimalRounding{
+	DR_HalfEven = 0,
+	DR_HalfUp,
+	DR_Down,
+	DR_Up,
+	DR_Floor,
+	DR_Ceiling,
+	DR_Count,
+};
+
+static const char *const decimal_rounding_names[DR_Count] = {
+	"half-even", "half-up", "down", "up", "floor", "ceiling"
+};
+
+// negative is the sign, which a zero coefficient cannot carry by itself
+typedef struct Decimal{
+	int64_t coefficient;
+	int32_t exponent;
+	bool negative;
+} Decimal;
+
+// set by every result that had to be rounded, like the inexact flag of the
+// decimal arithmetic specification, and only cleared by callers
+static bool decimal_inexact;
+
+// n is at most DECIMAL_WIDE_DIGITS
+static unsigned __int128 decimal_power(int n){
+	unsigned __int128 p = 1;
+	for (int i=0; i!=n; i+=1) p *= 10;
+	return p;
+}
+
+static int decimal_digit_count(unsigned __int128 x){
+	int n = 1;
+	for (; x>=10; x/=10) n += 1;
+	return n;
+}
+
+static unsigned __int128 decimal_magnitude(int64_t c){
+	return c < 0 ? -(uint64_t)c : (uint64_t)c;
+}
+
+// Rounds the magnitude x*10^exponent to 16 digits and an exponent in range,
+// zeros are added to the coefficient before a result overflows. Returns an
+// error message or NULL.
+static const char *decimal_round(bool negative, unsigned __int128 x, int32_t exponent, DecimalRounding mode, Decimal *res){
+	int32_t drop = decimal_digit_count(x) - DECIMAL_DIGITS;
+	if (drop < DECIMAL_MIN_EXPONENT - exponent) drop = DECIMAL_MIN_EXPONENT - exponent;
+	if (drop > 0){
+		unsigned __int128 q = 0;
+		int half = x == 0 ? 0 : -1; // how the dropped digits compare to half a unit
+		bool inexact = x != 0;
+		if (drop <= DECIMAL_WIDE_DIGITS){
+			unsigned __int128 p = decimal_power(drop);
+			q = x / p;
+			unsigned __int128 r = x % p;
+			inexact = r != 0;
+			half = 2*r < p ? -1 : 2*r > p ? 1 : 0;
+		}
+		bool up = false;
+		decimal_inexact |= inexact;
+		if (inexact){
+			switch (mode){
+			case DR_HalfEven: up = half > 0 || (half == 0 && (q & 1) != 0); break;
+			case DR_HalfUp:   up = half >= 0; break;
+			case DR_Down:     up = false; break;
+			case DR_Up:       up = true; break;
+			case DR_Floor:    up = negative; break;
+			case DR_Ceiling:  up = !negative; break;
+			}
+		}
+		x = q + up;
+		exponent += drop;
+		if (x == decimal_power(DECIMAL_DIGITS)){
+			x /= 10;
+			exponent += 1;
+		}
+	}
+	if (x == 0 && exponent > DECIMAL_MAX_EXPONENT) exponent = DECIMAL_MAX_EXPONENT;
+	while (exponent > DECIMAL_MAX_EXPONENT && x*10 < decimal_power(DECIMAL_DIGITS)){
+		x *= 10;
+		exponent -= 1;
+	}
+	if (exponent > DECIMAL_MAX_EXPONENT) return "decimal overflow";
+	res->coefficient = negative ? -(int64_t)x : (int64_t)x;
+	res->exponent = exponent;
+	res->negative = negative;
+	return NULL;
+}
+
+// The operand with the smaller exponent is cut to the digits that reach
+// below the 16 kept ones of the sum, with a sticky digit for the rest.
+static const char *decimal_add(Decimal a, Decimal b, DecimalRounding mode, Decimal *res){
+	if (a.exponent < b.exponent){
+		Decimal t = a;
+		a = b;
+		b = t;
+	}
+	if (a.coefficient == 0 && b.coefficient != 0){
+		*res = b;
+		return NULL;
+	}
+	int32_t shift = a.exponent - b.exponent;
+	int digits = decimal_digit_count(decimal_magnitude(a.coefficient));
+	__int128 x, y;
+	int32_t exponent;
+	if (digits + shift <= DECIMAL_WIDE_DIGITS - 1){
+		x = (__int128)a.coefficient * (__int128)decimal_power(shift);
+		y = b.coefficient;
+		exponent = b.exponent;
+	} else{
+		int kept = DECIMAL_WIDE_DIGITS - 1 - digits;
+		int32_t cut = shift - kept;
+		unsigned __int128 m = decimal_magnitude(b.coefficient);
+		unsigned __int128 t = 0;
+		bool sticky = m != 0;
+		if (cut <= DECIMAL_WIDE_DIGITS){
+			unsigned __int128 p = decimal_power(cut);
+			t = m / p;
+			sticky = m % p != 0;
+		}
+		x = (__int128)a.coefficient * (__int128)decimal_power(kept + 1);
+		y = (__int128)(t*10 + sticky);
+		if (b.coefficient < 0) y = -y;
+		exponent = a.exponent - kept - 1;
+	}
+	__int128 sum = x + y;
+	// a zero sum is negative when both operands are, or when rounding toward
+	// negative infinity and they have opposite signs
+	bool negative = sum < 0 || (sum == 0 && (a.negative == b.negative ? a.negative : mode == DR_Floor));
+	return decimal_round(negative, sum < 0 ? -(unsigned __int128)sum : (unsigned __int128)sum, exponent, mode, res);
+}
+
+static const char *decimal_sub(Decimal a, Decimal b, DecimalRounding mode, Decimal *res){
+	b.coefficient = -b.coefficient;
+	b.negative = !b.negative;
+	return decimal_add(a, b, mode, res);
+}
+
+static const char *decimal_mul(Decimal a, Decimal b, DecimalRounding mode, Decimal *res){
+	unsigned __int128 x = decimal_magnitude(a.coefficient) * decimal_magnitude(b.coefficient);
+	return decimal_round(a.negative != b.negative, x, a.exponent + b.exponent, mode, res);
+}
+
+// The dividend is scaled to 37 digits, which leaves at least 21 in the
+// quotient, and a remainder becomes a sticky digit. An exact quotient loses
+// its trailing zeros down to the exponent of a divided by b.
+static const char *decimal_div(Decimal a, Decimal b, DecimalRounding mode, Decimal *res){
+	if (b.coefficient == 0) return "divide by zero";
+	bool negative = a.negative != b.negative;
+	int32_t ideal = a.exponent - b.exponent;
+	if (a.coefficient == 0) return decimal_round(negative, 0, ideal, mode, res);
+	unsigned __int128 n = decimal_magnitude(a.coefficient);
+	unsigned __int128 d = decimal_magnitude(b.coefficient);
+	int scale = DECIMAL_WIDE_DIGITS - 1 - decimal_digit_count(n);
+	n *= decimal_power(scale);
+	unsigned __int128 q = n / d;
+	int32_t exponent = ideal - scale;
+	if (n % d != 0){
+		q = q*10 + 1;
+		exponent -= 1;
+	} else{
+		while (exponent < ideal && q % 10 == 0){
+			q /= 10;
+			exponent += 1;
+		}
+	}
+	return decimal_round(negative, q, exponent, mode, res);
+}
+
+static int decimal_compare(Decimal a, Decimal b){
+	int sa = (a.coefficient > 0) - (a.coefficient < 0);
+	int sb = (b.coefficient > 0) - (b.coefficient < 0);
+	if (sa != sb) return sa < sb ? -1 : 1;
+	if (sa == 0) return 0;
+	unsigned __int128 x = decimal_magnitude(a.coefficient);
+	unsigned __int128 y = decimal_magnitude(b.coefficient);
+	int32_t ax = decimal_digit_count(x) + a.exponent;
+	int32_t ay = decimal_digit_count(y) + b.exponent;
+	int order;
+	if (ax != ay){
+		order = ax < ay ? -1 : 1;
+	} else{
+		// equal adjusted exponents keep the shift below 16 digits
+		if (a.exponent > b.exponent) x *= decimal_power(a.exponent - b.exponent);
+		else y *= decimal_power(b.exponent - a.exponent);
+		order = x < y ? -1 : x > y ? 1 : 0;
+	}
+	return sa > 0 ? order : -order;
+}
+
+// by squaring, every product rounded
+static const char *decimal_pow_natural(Decimal a, uint64_t e, DecimalRounding mode, Decimal *res){
+	Decimal x = {.coefficient = 1};
+	for (; e!=0; e>>=1){
+		const char *error;
+		if (e & 1){
+			error = decimal_mul(x, a, mode, &x);
+			if (error != NULL) return error;
+		}
+		if (e > 1){
+			error = decimal_mul(a, a, mode, &a);
+			if (error != NULL) return error;
+		}
+	}
+	*res = x;
+	return NULL;
+}
+
+// A negative power divides 1 by the positive one. When that overflows or
+// drops below the 16 digits of the smallest normal exponent, the power is
+// taken of 1/a instead, so it underflows toward zero or overflows itself.
+static const char *decimal_pow(Decimal a, int64_t e, DecimalRounding mode, Decimal *res){
+	uint64_t bits = e < 0 ? -(uint64_t)e : (uint64_t)e;
+	if (e >= 0) return decimal_pow_natural(a, bits, mode, res);
+	if (a.coefficient == 0) return "divide by zero";
+	Decimal one = {.coefficient = 1}, x;
+	const char *error = decimal_pow_natural(a, bits, mode, &x);
+	int32_t adjusted = decimal_digit_count(decimal_magnitude(x.coefficient)) + x.exponent - 1;
+	if (error == NULL && x.coefficient != 0 && adjusted >= DECIMAL_MIN_EXPONENT + DECIMAL_DIGITS - 1)
+		return decimal_div(one, x, mode, res);
+	error = decimal_div(one, a, mode, &a);
+	if (error != NULL) return error;
+	return decimal_pow_natural(a, bits, mode, res);
+}
+
+// Reads digits with an optional fraction and exponent, as many as are given,
+// and rounds them once. Returns an error message or NULL, end is left where
+// reading stopped.
+static const char *decimal_parse(const char *text, const char **end, DecimalRounding mode, Decimal *res){
+	const char *it = text;
+	unsigned __int128 x = 0;
+	int digits = 0;
+	int32_t exponent = 0;
+	bool sticky = false;
+	bool point = false;
+	for (;; it+=1){
+		if (*it == '.' && !point){
+			point = true;
+			continue;
+		}
+		if (*it < '0' || '9' < *it) break;
+		if (digits < DECIMAL_WIDE_DIGITS - 1){
+			x = x*10 + (*it - '0');
+			if (x != 0) digits += 1;
+			if (point) exponent -= 1;
+		} else{
+			sticky |= *it != '0';
+			if (!point) exponent += 1;
+		}
+	}
+	if (*it == 'e' || *it == 'E'){
+		const char *e = it + 1;
+		bool negative = *e == '-';
+		if (*e == '+' || *e == '-') e += 1;
+		if ('0' <= *e && *e <= '9'){
+			int32_t power = 0;
+			for (; '0'<=*e && *e<='9'; e+=1){
+				if (power < 100000) power = power*10 + (*e - '0');
+			}
+			exponent += negative ? -power : power;
+			it = e;
+		}
+	}
+	*end = it;
+	if (sticky){
+		x = x*10 + 1;
+		exponent -= 1;
+	}
+	return decimal_round(false, x, exponent, mode, res);
+}
+
+// the shortest digits that read back as x, false for infinities and NaN
+static bool decimal_from_double(double x, DecimalRounding mode, Decimal *res){
+	if (!isfinite(x)) return false;
+	char text[32];
+	for (int precision=1; precision<=17; precision+=1){
+		snprintf(text, sizeof(text), "%.*e", precision-1, x);
+		if (strtod(text, NULL) == x) break;
+	}
+	const char *end;
+	bool negative = text[0] == '-';
+	decimal_parse(text + negative, &end, mode, res);
+	// integers keep their digits rather than print with an exponent
+	while (res->exponent > 0 && decimal_magnitude(res->coefficient)*10 < decimal_power(DECIMAL_DIGITS)){
+		res->coefficient *= 10;
+		res->exponent -= 1;
+	}
+	res->coefficient = negative ? -res->coefficient : res->coefficient;
+	res->negative = negative;
+	return true;
+}
+
+static double decimal_to_double(Decimal a){
+	char text[DECIMAL_TEXT_CAPACITY];
+	snprintf(text, sizeof(text), "%s%lluE%d",
+		a.negative ? "-" : "", (unsigned long long)decimal_magnitude(a.coefficient), (int)a.exponent);
+	return strtod(text, NULL);
+}
+
+// Like the to-scientific-string of the decimal arithmetic specification, the
+// digits of the coefficient with a point while the exponent is not positive
+// and the value not below 1e-6, otherwise one digit before the point and an
+// exponent. Trailing zeros stay, 2.50 prints as 2.50.
+static void decimal_format(Decimal a, char *res){
+	char digits[24];
+	int count = sprintf(digits, "%llu", (unsigned long long)decimal_magnitude(a.coefficient));
+	int32_t adjusted = a.exponent + count - 1;
+	int size = 0;
+	if (a.negative) res[size++] = '-';
+	if (a.exponent <= 0 && adjusted >= -6){
+		int32_t whole = count + a.exponent;
+		if (a.exponent == 0){
+			size += sprintf(res + size, "%s", digits);
+		} else if (whole > 0){
+			size += sprintf(res + size, "%.*s.%s", (int)whole, digits, digits + whole);
+		} else{
+			size += sprintf(res + size, "0.");
+			for (int32_t i=0; i!=-whole; i+=1) res[size++] = '0';
+			size += sprintf(res + size, "%s", digits);
+		}
+	} else{
+		res[size++] = digits[0];
+		if (count > 1) size += sprintf(res + size, ".%s", digits + 1);
+		sprintf(res + size, "E%+d", (int)adjusted);
+	}
+}
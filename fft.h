@@ -0,0 +1,190 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "utils.h"
+#include "parallel.h"
+
+// Complex FFT over split real and imaginary arrays, the inverse transform is
+// not scaled by 1/n. Powers of two go through the Stockham algorithm, which
+// sorts itself by ping-ponging between two buffers instead of permuting the
+// input, and every other size is a power of two sized convolution after
+// Bluestein's chirp substitution. Twiddle tables are computed once per size
+// and kept, so transforms must start from the main thread.
+
+#define FFT_VECTOR_LANES 2
+#define FFT_TASK (1 << 13)
+#define FFT_PARALLEL_MIN (1 << 16)
+
+typedef double FftVector __attribute__((vector_size(FFT_VECTOR_LANES * sizeof(double))));
+
+// exp(-2*pi*i*j/n) for j below n/2
+typedef struct FftTwiddles{
+	double *re;
+	double *im;
+} FftTwiddles;
+
+static FftTwiddles fft_twiddle_cache[64];
+
+static const FftTwiddles *fft_twiddles(size_t n){
+	FftTwiddles *res = fft_twiddle_cache + __builtin_ctzll(n);
+	if (res->re != NULL) return res;
+	res->re = malloc((n/2 + 1) * 2 * sizeof(double));
+	if (res->re == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	res->im = res->re + n/2 + 1;
+	for (size_t j=0; j!=n/2; j+=1){
+		double angle = -2.0 * M_PI * (double)j / (double)n;
+		res->re[j] = cos(angle);
+		res->im[j] = sin(angle);
+	}
+	return res;
+}
+
+// one radix 2 pass, sequences of length 2*m at stride s are split into their
+// even and odd outputs at stride 2*s
+typedef struct FftStage{
+	const double *xr, *xi;
+	double *yr, *yi;
+	const double *wr, *wi;
+	size_t m;
+	size_t s;
+	double sign;
+} FftStage;
+
+static inline FftVector fft_load(const double *p){
+	FftVector v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void fft_store(double *p, FftVector v){
+	memcpy(p, &v, sizeof(v));
+}
+
+// The butterflies of one twiddle are contiguous in q once the stride reaches
+// the vector width, so late passes run on whole vectors.
+static void fft_butterflies(const FftStage *st, size_t p_begin, size_t p_end, size_t q_begin, size_t q_end){
+	size_t s = st->s;
+	for (size_t p=p_begin; p!=p_end; p+=1){
+		double wr = st->wr[p*s];
+		double wi = st->sign * st->wi[p*s];
+		const double *ar = st->xr + s*p, *ai = st->xi + s*p;
+		const double *br = st->xr + s*(p + st->m), *bi = st->xi + s*(p + st->m);
+		double *cr = st->yr + s*2*p, *ci = st->yi + s*2*p;
+		double *dr = st->yr + s*(2*p + 1), *di = st->yi + s*(2*p + 1);
+		size_t q = q_begin;
+		if (s >= FFT_VECTOR_LANES){
+			for (; q!=q_end; q+=FFT_VECTOR_LANES){
+				FftVector vr = fft_load(ar + q), vi = fft_load(ai + q);
+				FftVector ur = fft_load(br + q), ui = fft_load(bi + q);
+				FftVector xr = vr - ur, xi = vi - ui;
+				fft_store(cr + q, vr + ur);
+				fft_store(ci + q, vi + ui);
+				fft_store(dr + q, xr*wr - xi*wi);
+				fft_store(di + q, xr*wi + xi*wr);
+			}
+		}
+		for (; q!=q_end; q+=1){
+			double xr = ar[q] - br[q], xi = ai[q] - bi[q];
+			cr[q] = ar[q] + br[q];
+			ci[q] = ai[q] + bi[q];
+			dr[q] = xr*wr - xi*wi;
+			di[q] = xr*wi + xi*wr;
+		}
+	}
+}
+
+// a task takes FFT_TASK butterflies, either whole twiddles or a part of one
+static void fft_stage_task(size_t index, void *data){
+	const FftStage *st = data;
+	size_t begin = index * FFT_TASK;
+	if (st->s >= FFT_TASK){
+		size_t q = begin % st->s;
+		fft_butterflies(st, begin / st->s, begin / st->s + 1, q, q + FFT_TASK);
+	} else{
+		fft_butterflies(st, begin / st->s, (begin + FFT_TASK) / st->s, 0, st->s);
+	}
+}
+
+static void fft_pow2(double *re, double *im, size_t n, bool inverse){
+	if (n < 2) return;
+	const FftTwiddles *tw = fft_twiddles(n);
+	double *buffer = malloc(2 * n * sizeof(double));
+	if (buffer == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	FftStage st = {
+		.xr = re, .xi = im, .yr = buffer, .yi = buffer + n,
+		.wr = tw->re, .wi = tw->im, .sign = inverse ? -1.0 : 1.0
+	};
+	for (st.m=n/2, st.s=1; st.m!=0; st.m/=2, st.s*=2){
+		if (n >= FFT_PARALLEL_MIN) parallel_for(n/2 / FFT_TASK, fft_stage_task, &st);
+		else fft_butterflies(&st, 0, st.m, 0, st.s);
+		const double *xr = st.xr, *xi = st.xi;
+		st.xr = st.yr;
+		st.xi = st.yi;
+		st.yr = (double *)xr;
+		st.yi = (double *)xi;
+	}
+	if (st.xr != re){
+		memcpy(re, st.xr, n * sizeof(double));
+		memcpy(im, st.xi, n * sizeof(double));
+	}
+	free(buffer);
+}
+
+// jk = (j^2 + k^2 - (k-j)^2)/2 turns the transform into a convolution with the
+// chirp exp(-pi*i*k^2/n), the angle is reduced modulo 2*pi through k^2 mod 2n
+static void fft_bluestein(double *re, double *im, size_t n, bool inverse){
+	size_t m = 1;
+	while (m < 2*n - 1) m *= 2;
+	double *buffer = calloc(6*m, sizeof(double));
+	if (buffer == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	double *ar = buffer, *ai = ar + m;
+	double *br = ai + m, *bi = br + m;
+	double *cr = bi + m, *ci = cr + m;
+	double sign = inverse ? -1.0 : 1.0;
+	for (size_t k=0; k!=n; k+=1){
+		uint64_t phase = (uint64_t)((unsigned __int128)k * k % (2*n));
+		double angle = M_PI * (double)phase / (double)n;
+		cr[k] = cos(angle);
+		ci[k] = -sign * sin(angle);
+		ar[k] = re[k]*cr[k] - im[k]*ci[k];
+		ai[k] = re[k]*ci[k] + im[k]*cr[k];
+		br[k] = cr[k];
+		bi[k] = -ci[k];
+		if (k != 0){
+			br[m-k] = cr[k];
+			bi[m-k] = -ci[k];
+		}
+	}
+	fft_pow2(ar, ai, m, false);
+	fft_pow2(br, bi, m, false);
+	for (size_t k=0; k!=m; k+=1){
+		double r = ar[k]*br[k] - ai[k]*bi[k];
+		double i = ar[k]*bi[k] + ai[k]*br[k];
+		ar[k] = r / (double)m;
+		ai[k] = i / (double)m;
+	}
+	fft_pow2(ar, ai, m, true);
+	for (size_t k=0; k!=n; k+=1){
+		re[k] = ar[k]*cr[k] - ai[k]*ci[k];
+		im[k] = ar[k]*ci[k] + ai[k]*cr[k];
+	}
+	free(buffer);
+}
+
+static void fft(double *re, double *im, size_t n, bool inverse){
+	if (n < 2) return;
+	if ((n & (n-1)) == 0) fft_pow2(re, im, n, inverse);
+	else fft_bluestein(re, im, n, inverse);
+}
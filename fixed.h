@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdio.h>
+#include <math.h>
+
+#include "utils.h"
+
+// Signed Q32.32 fixed point, a value is its raw integer over 2^32. Everything
+// is integer arithmetic in 128 bits rounded to nearest with ties away from
+// zero, so results are the same on every platform. Results out of range
+// saturate at the ends of the range or wrap around in two's complement.
+
+#define FIXED_FRACTION_BITS 32
+#define FIXED_ONE ((int64_t)1 << FIXED_FRACTION_BITS)
+#define FIXED_DIGITS_CAPACITY 64
+
+typedef uint8_t FixedOverflow;
+enum FixedOverflow{
+	FO_Saturate = 0,
+	FO_Wrap,
+};
+
+static int64_t fixed_narrow(__int128 x, FixedOverflow overflow){
+	if (overflow == FO_Wrap) return (int64_t)(uint64_t)x;
+	return x > INT64_MAX ? INT64_MAX : x < INT64_MIN ? INT64_MIN : (int64_t)x;
+}
+
+// x/2^bits
+static __int128 fixed_round_shift(__int128 x, int bits){
+	__int128 half = (__int128)1 << (bits - 1);
+	return x >= 0 ? (x + half) >> bits : -((-x + half) >> bits);
+}
+
+static int64_t fixed_add(int64_t a, int64_t b, FixedOverflow overflow){
+	return fixed_narrow((__int128)a + b, overflow);
+}
+
+static int64_t fixed_sub(int64_t a, int64_t b, FixedOverflow overflow){
+	return fixed_narrow((__int128)a - b, overflow);
+}
+
+static int64_t fixed_mul(int64_t a, int64_t b, FixedOverflow overflow){
+	return fixed_narrow(fixed_round_shift((__int128)a * b, FIXED_FRACTION_BITS), overflow);
+}
+
+// b is not zero
+static int64_t fixed_div(int64_t a, int64_t b, FixedOverflow overflow){
+	__int128 n = (__int128)a << FIXED_FRACTION_BITS;
+	__int128 q = n / b;
+	__int128 r = n % b;
+	__int128 r2 = r < 0 ? -2*r : 2*r;
+	if (r2 >= (b < 0 ? -(__int128)b : b)) q += (n < 0) != (b < 0) ? -1 : 1;
+	return fixed_narrow(q, overflow);
+}
+
+static int64_t fixed_pow_natural(int64_t a, uint64_t e, FixedOverflow overflow){
+	int64_t x = FIXED_ONE;
+	for (; e!=0; e>>=1){
+		if (e & 1) x = fixed_mul(x, a, overflow);
+		if (e > 1) a = fixed_mul(a, a, overflow);
+	}
+	return x;
+}
+
+// by squaring, every product rounded, false for a negative power of zero. A
+// negative power whose positive one rounds to zero is out of range, it comes
+// from the reciprocal of a instead so that it saturates or wraps like any
+// other result
+static bool fixed_pow(int64_t a, int64_t e, FixedOverflow overflow, int64_t *res){
+	uint64_t bits = e < 0 ? -(uint64_t)e : (uint64_t)e;
+	int64_t x = fixed_pow_natural(a, bits, overflow);
+	if (e < 0){
+		if (a == 0) return false;
+		x = x != 0
+			? fixed_div(FIXED_ONE, x, overflow)
+			: fixed_pow_natural(fixed_div(FIXED_ONE, a, overflow), bits, overflow);
+	}
+	*res = x;
+	return true;
+}
+
+// doubles scale exactly by 2^32, conversions always saturate
+static bool fixed_from_double(double x, int64_t *res){
+	if (x != x) return false;
+	double s = round(ldexp(x, FIXED_FRACTION_BITS));
+	*res = s >= 0x1p63 ? INT64_MAX : s < -0x1p63 ? INT64_MIN : (int64_t)s;
+	return true;
+}
+
+static double fixed_to_double(int64_t a){
+	return ldexp((double)a, -FIXED_FRACTION_BITS);
+}
+
+// every digit of the value, a 32 bit fraction ends after at most 32 of them,
+// at least 6 are written like for reals
+static void fixed_format(int64_t a, char *res){
+	uint64_t magnitude = a < 0 ? -(uint64_t)a : (uint64_t)a;
+	int size = sprintf(res, "%s%llu.", a < 0 ? "-" : "", (unsigned long long)(magnitude >> FIXED_FRACTION_BITS));
+	uint64_t fraction = magnitude & (FIXED_ONE - 1);
+	for (int i=0; i<6 || fraction!=0; i+=1){
+		fraction *= 10;
+		res[size] = '0' + (char)(fraction >> FIXED_FRACTION_BITS);
+		size += 1;
+		fraction &= FIXED_ONE - 1;
+	}
+	res[size] = '\0';
+}
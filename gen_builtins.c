@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "utils.h"
+
+// Writes a minimal perfect hash over the names in builtins.def. The high half
+// of the hash picks a bucket, the low half plus the bucket displacement picks
+// one of exactly as many slots as there are names.
+
+static const char *names[] = {
+#define BUILTIN_KEYWORD(name) #name,
+#define BUILTIN_CONSTANT(name, value) #name,
+#define BUILTIN_FUNCTION(name, args, call, kernel_op) #name,
+#define BUILTIN_FORM(name, form, call) #name,
+#include "builtins.def"
+};
+
+#define NAME_COUNT SIZE(names)
+#define BUCKET_COUNT ((NAME_COUNT+1) / 2)
+
+static uint64_t hashes[NAME_COUNT];
+static uint8_t displacements[BUCKET_COUNT];
+static int slots[NAME_COUNT];
+
+static bool try_seed(uint64_t seed){
+	size_t order[BUCKET_COUNT];
+	size_t bucket_sizes[BUCKET_COUNT] = {0};
+	for (size_t i=0; i!=NAME_COUNT; i+=1){
+		hashes[i] = hash_name(names[i], strlen(names[i]), seed);
+		bucket_sizes[(hashes[i] >> 32) % BUCKET_COUNT] += 1;
+	}
+	for (size_t i=0; i!=BUCKET_COUNT; i+=1) order[i] = i;
+	for (size_t i=1; i<BUCKET_COUNT; i+=1){
+		for (size_t j=i; j!=0 && bucket_sizes[order[j-1]] < bucket_sizes[order[j]]; j-=1){
+			size_t temp = order[j];
+			order[j] = order[j-1];
+			order[j-1] = temp;
+		}
+	}
+	for (size_t i=0; i!=NAME_COUNT; i+=1) slots[i] = -1;
+
+	// place the largest buckets first while the table is still empty
+	for (size_t b=0; b!=BUCKET_COUNT; b+=1){
+		size_t bucket = order[b];
+		if (bucket_sizes[bucket] == 0) break;
+		size_t disp = 0;
+		for (; disp!=NAME_COUNT; disp+=1){
+			size_t placed[NAME_COUNT];
+			size_t placed_count = 0;
+			bool ok = true;
+			for (size_t i=0; i!=NAME_COUNT && ok; i+=1){
+				if ((hashes[i] >> 32) % BUCKET_COUNT != bucket) continue;
+				size_t slot = ((uint32_t)hashes[i] + disp) % NAME_COUNT;
+				if (slots[slot] != -1){
+					ok = false;
+					break;
+				}
+				slots[slot] = i;
+				placed[placed_count] = slot;
+				placed_count += 1;
+			}
+			if (ok) break;
+			for (size_t i=0; i!=placed_count; i+=1) slots[placed[i]] = -1;
+		}
+		if (disp == NAME_COUNT) return false;
+		displacements[bucket] = disp;
+	}
+	return true;
+}
+
+int main(){
+	static_assert(NAME_COUNT <= 256, "builtin ids have to fit into uint8_t");
+	uint64_t seed = 0;
+	while (!try_seed(seed)) seed += 1;
+
+	printf("// generated by gen_builtins from builtins.def, do not edit\n\n");
+	printf("#define BUILTIN_SEED %lluull\n", (unsigned long long)seed);
+	printf("#define BUILTIN_BUCKETS %zu\n\n", BUCKET_COUNT);
+	printf("static const uint8_t builtin_displacements[BUILTIN_BUCKETS] = {");
+	for (size_t i=0; i!=BUCKET_COUNT; i+=1) printf("%s%u", i ? ", " : "", displacements[i]);
+	printf("};\n\n");
+	printf("static const uint8_t builtin_slots[%zu] = {", NAME_COUNT);
+	for (size_t i=0; i!=NAME_COUNT; i+=1) printf("%s%d", i ? ", " : "", slots[i]);
+	printf("};\n");
+	return 0;
+}
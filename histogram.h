@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "utils.h"
+#include "parallel.h"
+
+// Counts of doubles in equal bins. Every thread takes a contiguous part of the
+// input and counts into bins of its own, which are summed at the end, so no
+// counter is ever shared. Bin indices are computed a vector at a time, values
+// outside the range land in an extra bin that is dropped.
+
+#define HIST_VECTOR_LANES 2
+#define HIST_PARALLEL_MIN (1 << 16)
+
+typedef double HistVector __attribute__((vector_size(HIST_VECTOR_LANES * sizeof(double))));
+typedef int64_t HistMask __attribute__((vector_size(HIST_VECTOR_LANES * sizeof(int64_t))));
+
+// bin of x is floor((x - lo)*unit*scale) for lo <= x <= hi, the last bin
+// takes whatever rounds past it. unit is a power of two that is 1 unless the
+// range is so narrow that bin_count/(hi - lo) would overflow
+typedef struct Histogram{
+	const double *x;
+	size_t count;
+	size_t bin_count;
+	double lo, hi, unit, scale;
+	size_t task_count;
+	uint64_t *bins;
+} Histogram;
+
+static void hist_task(size_t index, void *data){
+	const Histogram *h = data;
+	size_t begin = index * h->count / h->task_count;
+	size_t end = (index + 1) * h->count / h->task_count;
+	uint64_t *bins = h->bins + index * (h->bin_count + 1);
+	memset(bins, 0, (h->bin_count + 1) * sizeof(uint64_t));
+	int64_t last = h->bin_count - 1;
+	int64_t dump = h->bin_count;
+	HistVector lo = {0}, hi = {0}, unit = {0}, scale = {0}, top = {0};
+	lo += h->lo;
+	hi += h->hi;
+	unit += h->unit;
+	scale += h->scale;
+	top += (double)last;
+
+	size_t i = begin;
+	for (; i+HIST_VECTOR_LANES<=end; i+=HIST_VECTOR_LANES){
+		HistVector v;
+		memcpy(&v, h->x + i, sizeof(v));
+		HistMask inside = (v >= lo) & (v <= hi);
+		HistVector t = (v - lo) * unit * scale;
+		// outside values become 0 and anything past the last bin becomes
+		// last before converting, so the conversion is always in range
+		HistMask over = t > top;
+		HistMask bits, top_bits;
+		memcpy(&bits, &t, sizeof(bits));
+		memcpy(&top_bits, &top, sizeof(top_bits));
+		bits = ((bits & ~over) | (top_bits & over)) & inside;
+		memcpy(&t, &bits, sizeof(t));
+		HistMask bin = __builtin_convertvector(t, HistMask);
+		bin = (bin & inside) | (dump & ~inside);
+		for (size_t l=0; l!=HIST_VECTOR_LANES; l+=1) bins[bin[l]] += 1;
+	}
+	for (; i!=end; i+=1){
+		double v = h->x[i];
+		if (!(v >= h->lo && v <= h->hi)){
+			bins[dump] += 1;
+			continue;
+		}
+		double t = (v - h->lo) * h->unit * h->scale;
+		bins[t < (double)last ? (int64_t)t : last] += 1;
+	}
+}
+
+static void histogram(Histogram *h, double *res){
+	h->task_count = h->count >= HIST_PARALLEL_MIN ? parallel_threads : 1;
+	h->bins = malloc(h->task_count * (h->bin_count + 1) * sizeof(uint64_t));
+	if (h->bins == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	parallel_for(h->task_count, hist_task, h);
+	for (size_t b=0; b!=h->bin_count; b+=1){
+		uint64_t sum = 0;
+		for (size_t t=0; t!=h->task_count; t+=1) sum += h->bins[t * (h->bin_count + 1) + b];
+		res[b] = (double)sum;
+	}
+	free(h->bins);
+}
+
+// sets up h for n bins from lo to hi, which must be finite with lo < hi. The
+// difference of two doubles is exact when they are that close, so scaling it
+// by a power of two first keeps the bins exact
+static void histogram_range(Histogram *h, size_t n, double lo, double hi){
+	h->bin_count = n;
+	h->lo = lo;
+	h->hi = hi;
+	h->unit = 1.0;
+	h->scale = (double)n / (hi - lo);
+	if (!isfinite(h->scale)){
+		h->unit = 0x1p512;
+		h->scale = (double)n / ((hi - lo) * h->unit);
+	}
+}
+
+// the largest value, or -1 when one is not a natural number
+typedef struct HistRange{
+	const double *x;
+	size_t count;
+	size_t task_count;
+	double *maxima;
+} HistRange;
+
+static void hist_range_task(size_t index, void *data){
+	const HistRange *r = data;
+	size_t begin = index * r->count / r->task_count;
+	size_t end = (index + 1) * r->count / r->task_count;
+	double max = 0.0;
+	bool natural = true;
+	for (size_t i=begin; i!=end; i+=1){
+		double v = r->x[i];
+		natural &= v >= 0.0 && v == floor(v);
+		max = v > max ? v : max;
+	}
+	r->maxima[index] = natural ? max : -1.0;
+}
+
+static double hist_natural_max(const double *x, size_t count){
+	double maxima[PARALLEL_MAX_THREADS];
+	HistRange r = {x, count, count >= HIST_PARALLEL_MIN ? parallel_threads : 1, maxima};
+	parallel_for(r.task_count, hist_range_task, &r);
+	double max = 0.0;
+	for (size_t t=0; t!=r.task_count; t+=1){
+		if (maxima[t] < 0.0) return -1.0;
+		max = maxima[t] > max ? maxima[t] : max;
+	}
+	return max;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "utils.h"
+#include "parallel.h"
+
+// Piecewise linear, natural cubic spline and monotone cubic interpolation of
+// tables of points with increasing x. Every segment keeps its start and its
+// polynomial together, so an evaluation touches one segment after the search.
+// Large tables are searched in Eytzinger order, where the next probes of a
+// search sit next to each other and can be prefetched, small ones with a
+// branchless binary search. Tables are built once and cached by the address of
+// their arrays, the owner of an array has to forget it before freeing it.
+
+#define INTERP_EYTZINGER_MIN 1024
+#define INTERP_CACHE_SIZE 8
+#define INTERP_TASK (1 << 14)
+#define INTERP_PARALLEL_MIN (1 << 16)
+
+typedef uint8_t InterpKind;
+enum InterpKind{
+	IK_Linear,
+	IK_Spline,
+	IK_Monotone
+};
+
+// y = a + t*(b + t*(c + t*d)) with t = x - start
+typedef struct InterpSegment{
+	double start;
+	double a, b, c, d;
+} InterpSegment;
+
+// the keys are the starts of all segments but the first, tree is 1 based
+typedef struct InterpTable{
+	const double *xs;
+	const double *ys;
+	size_t size;
+	InterpKind kind;
+	InterpSegment *segments;
+	double *tree;
+	uint32_t *ranks;
+} InterpTable;
+
+static InterpTable interp_cache[INTERP_CACHE_SIZE];
+static size_t interp_cache_next;
+
+static size_t interp_fill_tree(InterpTable *t, const double *keys, size_t count, size_t i, size_t k){
+	if (k > count) return i;
+	i = interp_fill_tree(t, keys, count, i, 2*k);
+	t->tree[k] = keys[i];
+	t->ranks[k] = i;
+	return interp_fill_tree(t, keys, count, i + 1, 2*k + 1);
+}
+
+// the number of keys not above x, which is the index of its segment
+static inline size_t interp_search(const InterpTable *t, double x){
+	const double *keys = t->xs + 1;
+	size_t count = t->size - 2;
+	if (t->tree != NULL){
+		size_t k = 1;
+		while (k <= count){
+			__builtin_prefetch(t->tree + 8*k);
+			k = 2*k + (t->tree[k] <= x);
+		}
+		k >>= __builtin_ffsll(~k);
+		return k != 0 ? t->ranks[k] : count;
+	}
+	if (count == 0) return 0;
+	const double *base = keys;
+	for (size_t len=count; len>1; len-=len/2){
+		base = base[len/2 - 1] <= x ? base + len/2 : base;
+	}
+	return (base - keys) + (*base <= x);
+}
+
+static inline double interp_at(const InterpTable *t, double x){
+	const InterpSegment *s = t->segments + interp_search(t, x);
+	double dx = x - s->start;
+	return s->a + dx*(s->b + dx*(s->c + dx*s->d));
+}
+
+// second derivatives of the natural spline from the tridiagonal system, which
+// is solved by forward elimination into m and back substitution
+static void interp_spline(InterpSegment *s, const double *xs, const double *ys, size_t n){
+	double *m = calloc(2*n, sizeof(double));
+	if (m == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	double *diag = m + n;
+	for (size_t i=1; i+1<n; i+=1){
+		double h0 = xs[i] - xs[i-1], h1 = xs[i+1] - xs[i];
+		double rhs = 6.0 * ((ys[i+1] - ys[i]) / h1 - (ys[i] - ys[i-1]) / h0);
+		diag[i] = 2.0 * (h0 + h1);
+		if (i > 1){
+			double f = h0 / diag[i-1];
+			diag[i] -= f * h0;
+			rhs -= f * m[i-1];
+		}
+		m[i] = rhs;
+	}
+	for (size_t i=n-1; i-->1;){
+		double h1 = xs[i+1] - xs[i];
+		m[i] = (m[i] - h1 * m[i+1]) / diag[i];
+	}
+	for (size_t j=0; j+1<n; j+=1){
+		double h = xs[j+1] - xs[j];
+		s[j].b = (ys[j+1] - ys[j]) / h - h * (2.0*m[j] + m[j+1]) / 6.0;
+		s[j].c = m[j] / 2.0;
+		s[j].d = (m[j+1] - m[j]) / (6.0 * h);
+	}
+	free(m);
+}
+
+// end slopes from a three point formula kept from overshooting
+static double interp_end_slope(double h0, double h1, double d0, double d1){
+	double slope = ((2.0*h0 + h1)*d0 - h0*d1) / (h0 + h1);
+	if ((slope > 0.0) != (d0 > 0.0) || d0 == 0.0) return 0.0;
+	if ((d0 > 0.0) != (d1 > 0.0) && fabs(slope) > 3.0*fabs(d0)) return 3.0*d0;
+	return slope;
+}
+
+// Fritsch-Carlson: the slope at a point is a weighted harmonic mean of the
+// secants around it and zero at extrema, so the curve never overshoots
+static void interp_monotone(InterpSegment *s, const double *xs, const double *ys, size_t n){
+	double *slopes = malloc(n * sizeof(double));
+	if (slopes == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	for (size_t i=1; i+1<n; i+=1){
+		double h0 = xs[i] - xs[i-1], h1 = xs[i+1] - xs[i];
+		double d0 = (ys[i] - ys[i-1]) / h0, d1 = (ys[i+1] - ys[i]) / h1;
+		double w0 = 2.0*h1 + h0, w1 = h1 + 2.0*h0;
+		slopes[i] = d0*d1 <= 0.0 ? 0.0 : (w0 + w1) / (w0/d0 + w1/d1);
+	}
+	if (n == 2){
+		slopes[0] = slopes[1] = (ys[1] - ys[0]) / (xs[1] - xs[0]);
+	} else{
+		slopes[0] = interp_end_slope(
+			xs[1] - xs[0], xs[2] - xs[1], (ys[1] - ys[0]) / (xs[1] - xs[0]), (ys[2] - ys[1]) / (xs[2] - xs[1])
+		);
+		slopes[n-1] = interp_end_slope(
+			xs[n-1] - xs[n-2], xs[n-2] - xs[n-3],
+			(ys[n-1] - ys[n-2]) / (xs[n-1] - xs[n-2]), (ys[n-2] - ys[n-3]) / (xs[n-2] - xs[n-3])
+		);
+	}
+	for (size_t j=0; j+1<n; j+=1){
+		double h = xs[j+1] - xs[j];
+		double secant = (ys[j+1] - ys[j]) / h;
+		s[j].b = slopes[j];
+		s[j].c = (3.0*secant - 2.0*slopes[j] - slopes[j+1]) / h;
+		s[j].d = (slopes[j] + slopes[j+1] - 2.0*secant) / (h*h);
+	}
+	free(slopes);
+}
+
+// returns an error message or NULL
+static const char *interp_build(InterpTable *t, const double *xs, const double *ys, size_t n, InterpKind kind){
+	if (n < 2) return "expected at least two points";
+	for (size_t i=1; i!=n; i+=1){
+		if (!(xs[i-1] < xs[i])) return "points must be increasing";
+	}
+	*t = (InterpTable){.xs = xs, .ys = ys, .size = n, .kind = kind};
+	t->segments = malloc((n-1) * sizeof(InterpSegment));
+	if (t->segments == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	for (size_t j=0; j+1<n; j+=1){
+		t->segments[j] = (InterpSegment){xs[j], ys[j], (ys[j+1] - ys[j]) / (xs[j+1] - xs[j]), 0.0, 0.0};
+	}
+	if (kind == IK_Spline) interp_spline(t->segments, xs, ys, n);
+	if (kind == IK_Monotone) interp_monotone(t->segments, xs, ys, n);
+
+	size_t count = n - 2;
+	if (count >= INTERP_EYTZINGER_MIN){
+		t->tree = aligned_alloc(64, ((count + 1) * sizeof(double) + 63) / 64 * 64);
+		t->ranks = malloc((count + 1) * sizeof(uint32_t));
+		if (t->tree == NULL || t->ranks == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+		interp_fill_tree(t, xs + 1, count, 0, 1);
+	}
+	return NULL;
+}
+
+static void interp_free(InterpTable *t){
+	free(t->segments);
+	free(t->tree);
+	free(t->ranks);
+	*t = (InterpTable){0};
+}
+
+// drops every cached table built on the array
+static void interp_forget(const double *array){
+	for (size_t i=0; i!=INTERP_CACHE_SIZE; i+=1){
+		if (interp_cache[i].segments != NULL && (interp_cache[i].xs == array || interp_cache[i].ys == array))
+			interp_free(interp_cache + i);
+	}
+}
+
+static const char *interp_table(const InterpTable **res, const double *xs, const double *ys, size_t n, InterpKind kind){
+	for (size_t i=0; i!=INTERP_CACHE_SIZE; i+=1){
+		const InterpTable *t = interp_cache + i;
+		if (t->segments != NULL && t->xs == xs && t->ys == ys && t->size == n && t->kind == kind){
+			*res = t;
+			return NULL;
+		}
+	}
+	InterpTable *t = interp_cache + interp_cache_next;
+	if (t->segments != NULL) interp_free(t);
+	const char *error = interp_build(t, xs, ys, n, kind);
+	if (error != NULL) return error;
+	interp_cache_next = (interp_cache_next + 1) % INTERP_CACHE_SIZE;
+	*res = t;
+	return NULL;
+}
+
+typedef struct InterpJob{
+	const InterpTable *table;
+	const double *x;
+	double *y;
+	size_t count;
+} InterpJob;
+
+static void interp_task(size_t index, void *data){
+	const InterpJob *job = data;
+	size_t end = (index + 1) * INTERP_TASK < job->count ? (index + 1) * INTERP_TASK : job->count;
+	for (size_t i=index*INTERP_TASK; i!=end; i+=1) job->y[i] = interp_at(job->table, job->x[i]);
+}
+
+static void interp_points(const InterpTable *t, const double *x, double *y, size_t count){
+	InterpJob job = {t, x, y, count};
+	if (count >= INTERP_PARALLEL_MIN) parallel_for((count + INTERP_TASK-1) / INTERP_TASK, interp_task, &job);
+	else for (size_t i=0; i!=count; i+=1) y[i] = interp_at(t, x[i]);
+}
@@ -1,8 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
 
 #include "utils.h"
+#include "random.h"
+#include "parallel.h"
+#include "primes.h"
+#include "modular.h"
+#include "combinatorics.h"
+#include "fft.h"
+#include "polynomial.h"
+#include "csv.h"
+#include "interp.h"
+#include "sort.h"
+#include "histogram.h"
+#include "units.h"
+#include "single.h"
+#include "fixed.h"
+#include "decimal.h"
 
 
 typedef uint16_t NodeType;
@@ -12,8 +34,18 @@ enum NodeType{
 	NT_Error,
 	NT_OpenPar,
 	NT_ClosePar,
+	NT_OpenBracket,
+	NT_CloseBracket,
+	NT_Comma,
+	NT_Assign,
+	NT_Call,
+	NT_List,
 	NT_Identifier,
 	NT_Number,
+	NT_Decimal,
+	NT_String,
+	NT_Operator,
+	NT_Plus,
 	NT_Minus,
 	NT_Add,
 	NT_Subtract,
@@ -21,21 +53,228 @@ enum NodeType{
 	NT_Divide,
 	NT_Power,
 	NT_Factorial,
+	NT_Less,
+	NT_LessEqual,
+	NT_Greater,
+	NT_GreaterEqual,
+	NT_Equal,
+	NT_NotEqual,
+	NT_And,
+	NT_Or,
+	NT_Question,
+	NT_Colon,
+	NT_User,
 };
 
 
+struct Function;
+struct Spelling;
+
 typedef struct Node{
 	NodeType type;
 	uint16_t size;
 	uint32_t pos;
 	union{
-		const char *name;
+		uint32_t atom;
+		const struct Function *function;
+		const struct Spelling *spelling;
 		const char *error;
 		int64_t integer;
 		double real;
 	};
+	union{
+		Units units;
+		int32_t exponent;
+	};
 } Node;
 
+typedef struct Precedence{
+	uint8_t left;
+	uint8_t right;
+} Precedence;
+
+typedef uint8_t Fixity;
+enum Fixity{
+	FX_Prefix = 0,
+	FX_Infix,
+	FX_Postfix,
+};
+
+// node type of the operator in every position, NT_Global where it is not declared
+typedef struct Spelling{
+	char text[4];
+	uint8_t size;
+	uint8_t next;
+	NodeType types[3];
+} Spelling;
+
+typedef struct UserOperator{
+	const struct Function *function;
+	uint8_t arity;
+} UserOperator;
+
+#define OPERATOR_CAPACITY 64
+#define USER_OPERATOR_CAPACITY 32
+#define NODE_TYPE_CAPACITY (NT_User + USER_OPERATOR_CAPACITY)
+
+// spellings sharing the first character are chained from first[] longest first,
+// so the lexer does one table index and then the maximal munch comparisons
+typedef struct OperatorTable{
+	uint8_t first[128];
+	uint8_t spelling_count;
+	uint8_t user_count;
+	Spelling spellings[OPERATOR_CAPACITY];
+	UserOperator users[USER_OPERATOR_CAPACITY];
+	Precedence precs[NODE_TYPE_CAPACITY];
+} OperatorTable;
+
+static OperatorTable operators;
+
+static Precedence get_prec(NodeType oper_type){
+	return operators.precs[oper_type];
+}
+
+static bool is_operator_char(char c){
+	return c != '\0' && strchr("+-*/^!%<>=&|~@#$\\", c) != NULL;
+}
+
+static const Spelling *match_operator(const char *it){
+	if (!is_operator_char(*it)) return NULL;
+	for (size_t i=operators.first[(uint8_t)*it]; i!=0; i=operators.spellings[i-1].next){
+		const Spelling *sp = operators.spellings + i-1;
+		if (memcmp(sp->text, it, sp->size) == 0) return sp;
+	}
+	return NULL;
+}
+
+typedef uint8_t BuiltinKind;
+enum BuiltinKind{
+	BK_Keyword = 0,
+	BK_Constant,
+	BK_Function,
+};
+
+// builtins take the first atom ids, in the order of builtins.def
+enum BuiltinAtom{
+#define BUILTIN_KEYWORD(name) BA_##name,
+#define BUILTIN_CONSTANT(name, value) BA_##name,
+#define BUILTIN_FUNCTION(name, args, call, kernel_op) BA_##name,
+#define BUILTIN_FORM(name, form, call) BA_##name,
+#include "builtins.def"
+#undef BUILTIN_KEYWORD
+#undef BUILTIN_CONSTANT
+#undef BUILTIN_FUNCTION
+#undef BUILTIN_FORM
+	BA_Count
+};
+
+static const char *const builtin_names[] = {
+#define BUILTIN_KEYWORD(name) #name,
+#define BUILTIN_CONSTANT(name, value) #name,
+#define BUILTIN_FUNCTION(name, args, call, kernel_op) #name,
+#define BUILTIN_FORM(name, form, call) #name,
+#include "builtins.def"
+#undef BUILTIN_KEYWORD
+#undef BUILTIN_CONSTANT
+#undef BUILTIN_FUNCTION
+#undef BUILTIN_FORM
+};
+
+static const BuiltinKind builtin_kinds[] = {
+#define BUILTIN_KEYWORD(name) BK_Keyword,
+#define BUILTIN_CONSTANT(name, value) BK_Constant,
+#define BUILTIN_FUNCTION(name, args, call, kernel_op) BK_Function,
+#define BUILTIN_FORM(name, form, call) BK_Function,
+#include "builtins.def"
+#undef BUILTIN_KEYWORD
+#undef BUILTIN_CONSTANT
+#undef BUILTIN_FUNCTION
+#undef BUILTIN_FORM
+};
+
+#include "builtins.h"
+static_assert(SIZE(builtin_slots) == BA_Count, "builtins.h is out of date");
+
+// one hash and one compare, returns BA_Count for names that are not builtins
+static uint32_t find_builtin(const char *name, size_t size){
+	uint64_t hash = hash_name(name, size, BUILTIN_SEED);
+	size_t slot = ((uint32_t)hash + builtin_displacements[(hash >> 32) % BUILTIN_BUCKETS]) % BA_Count;
+	uint32_t atom = builtin_slots[slot];
+	const char *builtin = builtin_names[atom];
+	if (strncmp(builtin, name, size) == 0 && builtin[size] == '\0') return atom;
+	return BA_Count;
+}
+
+
+#define ATOM_CAPACITY (1 << 16)
+#define ATOM_SLOTS (2 * ATOM_CAPACITY)
+#define ATOM_UNKNOWN (ATOM_CAPACITY - 1)
+
+// every identifier spelling is stored once, later stages compare the ids
+typedef struct AtomTable{
+	uint32_t count;
+	uint32_t slots[ATOM_SLOTS];
+	uint32_t offsets[ATOM_CAPACITY];
+	uint8_t sizes[ATOM_CAPACITY];
+	size_t chars_size;
+	size_t chars_capacity;
+	char *chars;
+} AtomTable;
+
+static AtomTable atoms = {.count = BA_Count};
+
+static const char *atom_name(uint32_t atom){
+	if (atom < BA_Count) return builtin_names[atom];
+	return atoms.chars + atoms.offsets[atom];
+}
+
+// slots hold atom+1 so that zero marks an empty slot, the slot of a name is
+// the one holding it or the empty one it would go to
+static size_t atom_slot(const char *name, size_t size){
+	size_t slot = hash_name(name, size, 0) & (ATOM_SLOTS-1);
+	for (;; slot=(slot+1) & (ATOM_SLOTS-1)){
+		uint32_t atom = atoms.slots[slot];
+		if (atom == 0) return slot;
+		atom -= 1;
+		if (atoms.sizes[atom] == size && memcmp(atom_name(atom), name, size) == 0) return slot;
+	}
+}
+
+// ATOM_UNKNOWN for a name that was never interned, no symbol ever has it
+static uint32_t find_atom(const char *name, size_t size){
+	uint32_t builtin = find_builtin(name, size);
+	if (builtin != BA_Count) return builtin;
+	uint32_t atom = atoms.slots[atom_slot(name, size)];
+	return atom != 0 ? atom - 1 : ATOM_UNKNOWN;
+}
+
+// ATOM_UNKNOWN once the table is full
+static uint32_t intern(const char *name, size_t size){
+	uint32_t builtin = find_builtin(name, size);
+	if (builtin != BA_Count) return builtin;
+
+	size_t slot = atom_slot(name, size);
+	if (atoms.slots[slot] != 0) return atoms.slots[slot] - 1;
+	if (atoms.count == ATOM_UNKNOWN) return ATOM_UNKNOWN;
+	if (atoms.chars_size + size + 1 > atoms.chars_capacity){
+		atoms.chars_capacity = 2*atoms.chars_capacity + size + 1024;
+		atoms.chars = realloc(atoms.chars, atoms.chars_capacity);
+		if (atoms.chars == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+	}
+	uint32_t atom = atoms.count;
+	atoms.count += 1;
+	atoms.offsets[atom] = atoms.chars_size;
+	atoms.sizes[atom] = size;
+	memcpy(atoms.chars + atoms.chars_size, name, size);
+	atoms.chars[atoms.chars_size + size] = '\0';
+	atoms.chars_size += size + 1;
+	atoms.slots[slot] = atom + 1;
+	return atom;
+}
+
 static bool is_character(char c){
 	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');
 }
@@ -44,6 +283,21 @@ static bool is_alnum(char c){
 	return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9');
 }
 
+// set by --decimal and --rounding, numbers are read as decimals and decimal
+// results are rounded in this mode, half to even unless it is given
+static bool decimal_literals;
+static DecimalRounding decimal_rounding;
+
+// set while the line editor lexes, a line that is still being typed only
+// looks names up so that no prefix of a name takes an atom
+static bool lex_without_interning;
+
+// false when a new name does not fit in the table
+static bool lex_atom(const char *name, size_t size, uint32_t *res){
+	*res = lex_without_interning ? find_atom(name, size) : intern(name, size);
+	return *res != ATOM_UNKNOWN || lex_without_interning;
+}
+
 static Node get_token(const char *line, const char **iter){
 	const char *it = *iter;
 	Node res = {0};
@@ -57,10 +311,44 @@ static Node get_token(const char *line, const char **iter){
 		it += 1;
 		res.type = NT_Newline;
 		break;
-	case '0'...'9':
+	case '0'...'9':{
+		if (decimal_literals && (it[0] != '0' || (it[1] != 'x' && it[1] != 'X'))){
+			const char *end;
+			Decimal d;
+			decimal_inexact = false;
+			const char *error = decimal_parse(it, &end, decimal_rounding, &d);
+			double factor;
+			Units units;
+			const char *after = end;
+			// literals round to 16 digits, except integers written with only
+			// digits, which would silently stop being exact
+			if (error == NULL && decimal_inexact && strspn(it, "0123456789") == (size_t)(end - it))
+				error = "integer has more digits than a decimal";
+			if (parse_units(&after, &factor, &units) == NULL && units == 0){
+				if (error != NULL){
+					res.type = NT_Error;
+					res.error = error;
+					goto Return;
+				}
+				res.type = NT_Decimal;
+				res.integer = d.coefficient;
+				res.exponent = d.exponent;
+				it = end;
+				break;
+			}
+		}
 		res.type = NT_Number;
 		res.real = strtod(it, (char **)&it);
+		double factor;
+		const char *error = parse_units(&it, &factor, &res.units);
+		if (error != NULL){
+			res.type = NT_Error;
+			res.error = error;
+			goto Return;
+		}
+		res.real *= factor;
 		break;
+	}
 	case '(':
 		it += 1;
 		res.type = NT_OpenPar;
@@ -69,142 +357,2874 @@ static Node get_token(const char *line, const char **iter){
 		it += 1;
 		res.type = NT_ClosePar;
 		break;
-	case '+':
+	case '[':
 		it += 1;
-		res.type = NT_Add;
+		res.type = NT_OpenBracket;
 		break;
-	case '-':
+	case ']':
 		it += 1;
-		res.type = NT_Subtract;
+		res.type = NT_CloseBracket;
 		break;
-	case '*':
+	case ',':
 		it += 1;
-		res.type = NT_Multiply;
+		res.type = NT_Comma;
 		break;
-	case '/':
+	case '?':
 		it += 1;
-		res.type = NT_Divide;
+		res.type = NT_Question;
 		break;
-	case '^':
+	case ':':
 		it += 1;
-		res.type = NT_Power;
+		res.type = NT_Colon;
 		break;
-	case '!':
-		it += 1;
-		res.type = NT_Factorial;
+	case '"':{
+		const char *text = it + 1;
+		const char *end = strchr(text, '"');
+		if (end == NULL){
+			res.type = NT_Error;
+			res.error = "string not closed";
+			goto Return;
+		}
+		if (end - text > UINT8_MAX){
+			res.type = NT_Error;
+			res.error = "string too long";
+			goto Return;
+		}
+		it = end + 1;
+		res.type = NT_String;
+		if (!lex_atom(text, end - text, &res.atom)){
+			res.type = NT_Error;
+			res.error = "too many identifiers";
+			goto Return;
+		}
 		break;
+	}
 	default:
+		res.spelling = match_operator(it);
+		if (res.spelling != NULL){
+			it += res.spelling->size;
+			res.type = NT_Operator;
+			break;
+		}
 		if (is_character(*it)){
-			res.type = NT_Identifier;
-			res.name = it;
+			const char *name = it;
 			do{ it += 1; } while (is_alnum(*it));
-			res.size = it - res.name;
-			if (res.size > 64){
+			if (it - name > 64){
 				res.type = NT_Error;
 				res.error = "identifier name too long";
 				goto Return;
 			}
+			res.type = NT_Identifier;
+			if (!lex_atom(name, it - name, &res.atom)){
+				res.type = NT_Error;
+				res.error = "too many identifiers";
+				goto Return;
+			}
+			break;
+		}
+		if (*it == '='){
+			it += 1;
+			res.type = NT_Assign;
 			break;
 		}
 		res.type = NT_Error;
 		res.error = "unrecognized token";
 	}
-Return:
-	*iter = it;
+Return:
+	*iter = it;
+	return res;
+}
+
+#define TOKEN_CAPACITY 256
+
+// the last token is either a newline or the first error on the line
+static size_t tokenize(const char *line, const char *it, Node *tokens){
+	for (size_t count=0;; count+=1){
+		if (count == TOKEN_CAPACITY-1){
+			tokens[count] = (Node){.type = NT_Error, .pos = it - line, .error = "line too long"};
+			return count + 1;
+		}
+		tokens[count] = get_token(line, &it);
+		if (tokens[count].type == NT_Newline || tokens[count].type == NT_Error) return count + 1;
+	}
+}
+
+
+typedef uint16_t DataType;
+enum DataType{
+	DT_Void = 0,
+	DT_Error,
+	DT_Lanes,
+	DT_Kernel,
+	DT_Data,
+	DT_Path,
+	DT_Real,
+	DT_Vector,
+	DT_Big,
+	DT_Poly,
+	DT_Modular,
+	DT_Fixed,
+	DT_Decimal,
+};
+
+struct Kernel;
+
+// Types from DT_Real on are the ones that can be printed and assigned. Lanes
+// only exist while an expression is compiled, they are the register that will
+// hold the value of a subexpression for every lane of a batch, data is a file
+// handed to a form and a path names a file that a form writes. Big values are
+// exact naturals too large for a double, and polynomials keep their
+// coefficients lowest power first like a vector. A modular value is a residue
+// and the index of its modulus in the moduli table. A fixed point value is its
+// raw Q32.32 integer, and a decimal is its coefficient and exponent. Reals and
+// lanes have units, which are checked and combined while a line is evaluated
+// or compiled, never while a kernel runs.
+typedef struct Value{
+	DataType type;
+	uint16_t size;
+	union{
+		uint32_t length;
+		uint32_t modulus;
+		Units units;
+		int32_t exponent;
+	};
+	union{
+		double real;
+		int64_t integer;
+		uint64_t residue;
+		const char *string;
+		const char *error;
+		double *reals;
+		uint64_t *limbs;
+		uint32_t reg;
+		struct Kernel *kernel;
+		Dataset *dataset;
+	};
+} Value;
+
+#define REAL_VALUE(x) (Value){.type=DT_Real, .real=(x)}
+#define ERROR_VALUE(msg, pos) (Value){.type=DT_Error, .size=(pos), .error=(msg)}
+
+static Units value_units(Value value){
+	return value.type == DT_Real || value.type == DT_Lanes ? value.units : 0;
+}
+
+// memory of values that live until the next line is evaluated, vectors are
+// copied out of it when they get assigned
+typedef struct TempArena{
+	size_t count;
+	size_t capacity;
+	void **blocks;
+} TempArena;
+
+static TempArena temps;
+
+static void *checked_malloc(size_t size){
+	void *res = malloc(size ? size : 1);
+	if (res == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	return res;
+}
+
+// takes over a block from malloc
+static void *temp_adopt(void *block){
+	if (temps.count == temps.capacity){
+		temps.capacity = temps.capacity ? 2*temps.capacity : 64;
+		temps.blocks = realloc(temps.blocks, temps.capacity * sizeof(void *));
+		if (temps.blocks == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+	}
+	temps.blocks[temps.count] = block;
+	temps.count += 1;
+	return block;
+}
+
+static void *temp_alloc(size_t size){
+	return temp_adopt(checked_malloc(size));
+}
+
+static void temp_reset(void){
+	for (size_t i=0; i!=temps.count; i+=1){
+		interp_forget(temps.blocks[i]);
+		free(temps.blocks[i]);
+	}
+	temps.count = 0;
+}
+
+static Value make_vector(size_t length){
+	return (Value){.type = DT_Vector, .length = length, .reals = temp_alloc(length * sizeof(double))};
+}
+
+static Value make_poly(size_t length){
+	return (Value){.type = DT_Poly, .length = length, .reals = temp_alloc(length * sizeof(double))};
+}
+
+// reals are constant polynomials, the zero polynomial has no coefficients
+static bool to_poly(Value *value){
+	if (value->type == DT_Poly) return true;
+	if (value->type != DT_Real) return false;
+	double c = value->real;
+	*value = make_poly(c != 0.0);
+	if (c != 0.0) value->reals[0] = c;
+	return true;
+}
+
+// naturals that fit a double stay reals
+static Value make_big(Big x){
+	x = big_trim(x);
+	if (x.size == 0 || (x.size == 1 && x.limbs[0] <= (1ull << 53))){
+		double res = x.size == 0 ? 0.0 : (double)x.limbs[0];
+		free(x.limbs);
+		return REAL_VALUE(res);
+	}
+	return (Value){.type = DT_Big, .length = x.size, .limbs = temp_adopt(x.limbs)};
+}
+
+static Big get_big(Value value){
+	return (Big){value.length, value.limbs};
+}
+
+// exact results turn into reals as soon as they are computed with
+static void demote_bigs(Value *args, size_t arg_count){
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (args[i].type == DT_Big) args[i] = REAL_VALUE(big_to_double(get_big(args[i])));
+	}
+}
+
+#define MODULUS_CAPACITY 64
+
+// every modulus that was used, values refer to them by index, prime moduli
+// get a factorial table once a binomial is taken modulo them
+static Modulus moduli[MODULUS_CAPACITY];
+static FactorialTable factorial_tables[MODULUS_CAPACITY];
+static size_t modulus_count;
+
+// set by --overflow, fixed point results out of range saturate unless it is wrap
+static FixedOverflow fixed_overflow;
+
+static Value make_fixed(int64_t raw){
+	return (Value){.type = DT_Fixed, .integer = raw};
+}
+
+// reals and big values join fixed point rounded to nearest
+static bool to_fixed(Value value, int64_t *res){
+	if (value.type == DT_Fixed){
+		*res = value.integer;
+		return true;
+	}
+	demote_bigs(&value, 1);
+	return value.type == DT_Real && fixed_from_double(value.real, res);
+}
+
+// the sign of a zero is the lowest bit of the exponent field
+static Value make_decimal(Decimal d){
+	return (Value){.type = DT_Decimal, .exponent = d.exponent*2 + d.negative, .integer = d.coefficient};
+}
+
+static Decimal get_decimal(Value value){
+	int32_t sign = value.exponent & 1;
+	return (Decimal){.coefficient = value.integer, .exponent = (value.exponent - sign) / 2, .negative = sign != 0};
+}
+
+// decimals turn into reals where a real is expected
+static void demote_decimals(Value *args, size_t arg_count){
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (args[i].type == DT_Decimal) args[i] = REAL_VALUE(decimal_to_double(get_decimal(args[i])));
+	}
+}
+
+// reals join decimals with the shortest digits that read back as them and big
+// values with all of theirs, both rounded to 16 digits
+static bool to_decimal(Value value, Decimal *res){
+	if (value.type == DT_Decimal){
+		*res = get_decimal(value);
+		return true;
+	}
+	if (value.type == DT_Big){
+		char *digits = big_to_decimal(get_big(value));
+		const char *end;
+		bool ok = decimal_parse(digits, &end, decimal_rounding, res) == NULL;
+		free(digits);
+		return ok;
+	}
+	return value.type == DT_Real && value.units == 0 && decimal_from_double(value.real, decimal_rounding, res);
+}
+
+static Value make_modular(uint64_t residue, uint64_t n){
+	size_t i = 0;
+	while (i != modulus_count && moduli[i].n != n) i += 1;
+	if (i == MODULUS_CAPACITY) return ERROR_VALUE("too many moduli", 0);
+	if (i == modulus_count){
+		moduli[i] = modulus_init(n);
+		modulus_count += 1;
+	}
+	return (Value){.type = DT_Modular, .modulus = i, .residue = residue};
+}
+
+#define VECTOR_PRINT_LIMIT 16
+
+static void print_value(Value value){
+	if (value.type == DT_Real){
+		printf("%lf", value.real);
+		print_units(value.units);
+		return;
+	}
+	if (value.type == DT_Modular){
+		printf("%llu (mod %llu)", (unsigned long long)value.residue, (unsigned long long)moduli[value.modulus].n);
+		return;
+	}
+	if (value.type == DT_Fixed){
+		char digits[FIXED_DIGITS_CAPACITY];
+		fixed_format(value.integer, digits);
+		printf("fixed(%s)", digits);
+		return;
+	}
+	if (value.type == DT_Decimal){
+		char digits[DECIMAL_TEXT_CAPACITY];
+		decimal_format(get_decimal(value), digits);
+		fputs(digits, stdout);
+		return;
+	}
+	if (value.type == DT_Big){
+		char *digits = big_to_decimal(get_big(value));
+		fputs(digits, stdout);
+		free(digits);
+		return;
+	}
+	if (value.type == DT_Poly) printf("poly(");
+	putchar('[');
+	for (size_t i=0; i!=value.length; i+=1){
+		if (i == VECTOR_PRINT_LIMIT){
+			printf(", ... %u elements", value.length);
+			break;
+		}
+		printf(i == 0 ? "%lf" : ", %lf", value.reals[i]);
+	}
+	putchar(']');
+	if (value.type == DT_Poly) putchar(')');
+}
+
+
+static const double constants[BA_Count] = {
+#define BUILTIN_KEYWORD(name)
+#define BUILTIN_CONSTANT(name, value) [BA_##name] = value,
+#define BUILTIN_FUNCTION(name, args, call, kernel_op)
+#define BUILTIN_FORM(name, form, call)
+#include "builtins.def"
+#undef BUILTIN_KEYWORD
+#undef BUILTIN_CONSTANT
+#undef BUILTIN_FUNCTION
+#undef BUILTIN_FORM
+};
+
+#define NO_ATOM UINT32_MAX
+
+// Compressed trie over the names that can be completed. An edge label is a
+// slice of the name of label_atom, and the path from the root to a node is a
+// prefix of that same name. Siblings are kept sorted by their first character.
+typedef struct TrieNode{
+	uint32_t atom;
+	uint32_t label_atom;
+	uint8_t label_begin;
+	uint8_t label_size;
+	uint32_t child;
+	uint32_t sibling;
+} TrieNode;
+
+typedef struct SymbolTrie{
+	bool has_builtins;
+	uint32_t node_count;
+	uint32_t node_capacity;
+	TrieNode *nodes;
+} SymbolTrie;
+
+static const char *trie_label(const SymbolTrie *trie, uint32_t node){
+	return atom_name(trie->nodes[node].label_atom) + trie->nodes[node].label_begin;
+}
+
+static uint32_t trie_new_node(SymbolTrie *trie, TrieNode node){
+	if (trie->node_count == trie->node_capacity){
+		trie->node_capacity = trie->node_capacity ? 2*trie->node_capacity : 64;
+		trie->nodes = realloc(trie->nodes, trie->node_capacity * sizeof(TrieNode));
+		if (trie->nodes == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+	}
+	trie->nodes[trie->node_count] = node;
+	trie->node_count += 1;
+	return trie->node_count - 1;
+}
+
+// returns the link that points at the child starting with c, or where it belongs
+static uint32_t *trie_child_link(SymbolTrie *trie, uint32_t node, char c){
+	uint32_t *link = &trie->nodes[node].child;
+	while (*link != 0 && trie_label(trie, *link)[0] < c) link = &trie->nodes[*link].sibling;
+	return link;
+}
+
+static void trie_insert(SymbolTrie *trie, uint32_t atom){
+	if (trie->node_count == 0) trie_new_node(trie, (TrieNode){.atom = NO_ATOM});
+	const char *name = atom_name(atom);
+	size_t size = strlen(name);
+	uint32_t node = 0;
+	size_t depth = 0;
+	while (depth != size){
+		uint32_t *link = trie_child_link(trie, node, name[depth]);
+		uint32_t child = *link;
+		if (child == 0 || trie_label(trie, child)[0] != name[depth]){
+			uint32_t leaf = trie_new_node(trie, (TrieNode){
+				.atom = atom, .label_atom = atom, .label_begin = depth, .label_size = size - depth, .sibling = child
+			});
+			*trie_child_link(trie, node, name[depth]) = leaf;
+			return;
+		}
+		const char *label = trie_label(trie, child);
+		size_t common = 0;
+		while (common != trie->nodes[child].label_size && label[common] == name[depth+common]) common += 1;
+		if (common != trie->nodes[child].label_size){
+			TrieNode old = trie->nodes[child];
+			uint32_t split = trie_new_node(trie, (TrieNode){
+				.atom = NO_ATOM, .label_atom = old.label_atom, .label_begin = old.label_begin,
+				.label_size = common, .child = child, .sibling = old.sibling
+			});
+			*trie_child_link(trie, node, name[depth]) = split;
+			trie->nodes[child].label_begin += common;
+			trie->nodes[child].label_size -= common;
+			trie->nodes[child].sibling = 0;
+			child = split;
+		}
+		node = child;
+		depth += common;
+	}
+	trie->nodes[node].atom = atom;
+}
+
+// the node below which every name starts with the prefix, 0 if there is none
+static uint32_t trie_find(SymbolTrie *trie, const char *prefix, size_t size){
+	if (trie->node_count == 0) return 0;
+	uint32_t node = 0;
+	size_t depth = 0;
+	while (depth < size){
+		uint32_t child = *trie_child_link(trie, node, prefix[depth]);
+		if (child == 0) return 0;
+		const char *label = trie_label(trie, child);
+		size_t label_size = trie->nodes[child].label_size;
+		for (size_t i=0; i!=label_size && depth+i!=size; i+=1){
+			if (label[i] != prefix[depth+i]) return 0;
+		}
+		node = child;
+		depth += label_size;
+	}
+	return node;
+}
+
+// number of characters of the node's name that every name below it shares
+static size_t trie_common_size(const SymbolTrie *trie, uint32_t node){
+	while (trie->nodes[node].atom == NO_ATOM){
+		uint32_t child = trie->nodes[node].child;
+		if (child == 0 || trie->nodes[child].sibling != 0) break;
+		node = child;
+	}
+	return trie->nodes[node].label_begin + trie->nodes[node].label_size;
+}
+
+// visits the names below node in sorted order
+static void trie_walk(const SymbolTrie *trie, uint32_t node, void (*visit)(uint32_t atom, void *data), void *data){
+	if (trie->nodes[node].atom != NO_ATOM) visit(trie->nodes[node].atom, data);
+	for (uint32_t child=trie->nodes[node].child; child!=0; child=trie->nodes[child].sibling)
+		trie_walk(trie, child, visit, data);
+}
+
+
+// values are indexed by atom, DT_Void marks a name that was never assigned,
+// the trie holds the names of builtins and assigned symbols for completion
+typedef struct SymbolTable{
+	Value values[ATOM_CAPACITY];
+	SymbolTrie trie;
+} SymbolTable;
+
+static Value get_identifier(const SymbolTable *symbols, uint32_t atom){
+	if (atom < BA_Count && builtin_kinds[atom] == BK_Constant)
+		return (Value){.type = DT_Real, .real = constants[atom]};
+	if (symbols->values[atom].type == DT_Void)
+		return (Value){.type = DT_Error, .error = "identifier not found"};
+	return symbols->values[atom];
+}
+
+static bool owns_array(Value value){
+	return value.type == DT_Vector || value.type == DT_Big || value.type == DT_Poly;
+}
+
+// symbols own their vectors, big values and polynomials, the new value is copied before the
+// old one is freed because it can be a part of it
+static void set_identifier(SymbolTable *symbols, uint32_t atom, Value value){
+	if (symbols->values[atom].type == DT_Void) trie_insert(&symbols->trie, atom);
+	if (owns_array(value)){
+		double *reals = checked_malloc(value.length * sizeof(double));
+		memcpy(reals, value.reals, value.length * sizeof(double));
+		value.reals = reals;
+	}
+	if (owns_array(symbols->values[atom])){
+		interp_forget(symbols->values[atom].reals);
+		free(symbols->values[atom].reals);
+	}
+	symbols->values[atom] = value;
+}
+
+// builtins join the trie the first time it is searched, not at startup
+static SymbolTrie *get_symbol_trie(SymbolTable *symbols){
+	if (!symbols->trie.has_builtins){
+		for (uint32_t atom=0; atom!=BA_Count; atom+=1) trie_insert(&symbols->trie, atom);
+		symbols->trie.has_builtins = true;
+	}
+	return &symbols->trie;
+}
+
+typedef uint8_t WindowKind;
+enum WindowKind{
+	WK_None = 0,
+	WK_Sum,
+	WK_Min,
+	WK_Max,
+	WK_Ewma,
+};
+
+// state of one windowed call site, kept between the samples of a stream
+typedef struct Window{
+	WindowKind kind;
+	size_t size;
+	size_t count;
+	double *values;
+	size_t *indices;
+	size_t front;
+	size_t back;
+	double sum;
+	double compensation;
+} Window;
+
+#define WINDOW_CAPACITY 16
+#define WINDOW_MAX_SIZE (1 << 24)
+typedef struct Stream{
+	size_t window_count;
+	Window windows[WINDOW_CAPACITY];
+} Stream;
+
+// call sites are identified by the order in which they are evaluated,
+// which stays the same as long as the stream expression does not change
+static Window *get_window(Stream *stream, WindowKind kind, double size, const char **error){
+	if (stream == NULL){
+		*error = "window function outside stream mode";
+		return NULL;
+	}
+	if (stream->window_count == WINDOW_CAPACITY){
+		*error = "too many window functions";
+		return NULL;
+	}
+	if (!(1.0 <= size && size <= WINDOW_MAX_SIZE) || size != floor(size)){
+		*error = "invalid window size";
+		return NULL;
+	}
+	Window *window = stream->windows + stream->window_count;
+	stream->window_count += 1;
+
+	if (window->kind == WK_None){
+		window->kind = kind;
+		window->size = (size_t)size;
+		if (kind != WK_Ewma){
+			window->values = malloc(window->size * sizeof(double));
+			window->indices = malloc(window->size * sizeof(size_t));
+			if (window->values == NULL || window->indices == NULL){
+				fprintf(stderr, "ERROR: out of memory\n");
+				exit(1);
+			}
+		}
+	} else if (window->kind != kind || window->size != (size_t)size){
+		*error = "window changed between samples";
+		return NULL;
+	}
+	return window;
+}
+
+static void compensated_add(double *sum, double *compensation, double x){
+	double t = *sum + x;
+	if (fabs(*sum) >= fabs(x))
+		*compensation += (*sum - t) + x;
+	else
+		*compensation += (x - t) + *sum;
+	*sum = t;
+}
+
+static double window_push_sum(Window *w, double x){
+	double *slot = w->values + w->count % w->size;
+	if (w->count >= w->size) compensated_add(&w->sum, &w->compensation, -*slot);
+	compensated_add(&w->sum, &w->compensation, x);
+	*slot = x;
+	w->count += 1;
+	return w->sum + w->compensation;
+}
+
+// monotonic deque, the front holds the extreme of the last size samples
+static double window_push_extreme(Window *w, double x){
+	size_t t = w->count;
+	if (w->front != w->back && w->indices[w->front % w->size] + w->size <= t) w->front += 1;
+	while (w->front != w->back){
+		double last = w->values[(w->back-1) % w->size];
+		if (w->kind == WK_Max ? last > x : last < x) break;
+		w->back -= 1;
+	}
+	w->values[w->back % w->size] = x;
+	w->indices[w->back % w->size] = t;
+	w->back += 1;
+	w->count += 1;
+	return w->values[w->front % w->size];
+}
+
+
+// both operands are always evaluated, so conditionals reduce to flag arithmetic
+// and selects that compile to conditional moves instead of branches
+static double select_real(double cond, double a, double b){
+	return cond != 0.0 ? a : b;
+}
+
+static double compare(NodeType oper, double a, double b){
+	switch (oper){
+	case NT_Less:         return (double)(a < b);
+	case NT_LessEqual:    return (double)(a <= b);
+	case NT_Greater:      return (double)(a > b);
+	case NT_GreaterEqual: return (double)(a >= b);
+	case NT_Equal:        return (double)(a == b);
+	case NT_NotEqual:     return (double)(a != b);
+	case NT_And:          return (double)((a != 0.0) & (b != 0.0));
+	case NT_Or:           return (double)((a != 0.0) | (b != 0.0));
+	default:              return NAN;
+	}
+}
+
+
+#define KERNEL_LANES 64
+#define KERNEL_CAPACITY 256
+#define KERNEL_VAR_CAPACITY 16
+
+typedef uint8_t KernelOpcode;
+enum KernelOpcode{
+	KO_None = 0,
+	KO_Negate,
+	KO_Add,
+	KO_Subtract,
+	KO_Multiply,
+	KO_Divide,
+	KO_Power,
+	KO_Factorial,
+	KO_Less,
+	KO_LessEqual,
+	KO_Greater,
+	KO_GreaterEqual,
+	KO_Equal,
+	KO_NotEqual,
+	KO_And,
+	KO_Or,
+	KO_Select,
+	KO_Sqrt,
+	KO_Log,
+	KO_Exp,
+	KO_Sin,
+	KO_Cos,
+	KO_Tan,
+	KO_Abs,
+	KO_Percent,
+	KO_Rand,
+	KO_Randn,
+	KO_Randu,
+	KO_Randint,
+	KO_Randexp,
+};
+
+typedef struct KernelOp{
+	KernelOpcode code;
+	uint8_t stream;
+	uint16_t dst;
+	uint16_t args[3];
+} KernelOp;
+
+typedef struct KernelConstant{
+	uint16_t reg;
+	double value;
+} KernelConstant;
+
+// An expression compiled for batches. Every op writes a register of its own,
+// the first var_count registers hold the variables and are filled by the caller.
+// Random ops draw from streams of their own, so a lane gets the same numbers
+// whichever batch or thread evaluates it. Single kernels run over floats in the
+// forms that support it.
+typedef struct Kernel{
+	bool single;
+	uint16_t var_count;
+	uint16_t reg_count;
+	uint16_t op_count;
+	uint16_t const_count;
+	uint16_t stream_count;
+	uint16_t result;
+	uint32_t vars[KERNEL_VAR_CAPACITY];
+	KernelOp ops[KERNEL_CAPACITY];
+	KernelConstant consts[KERNEL_CAPACITY];
+} Kernel;
+
+typedef double Lanes[KERNEL_LANES];
+typedef float SingleLanes[KERNEL_LANES];
+
+static_assert(KERNEL_LANES % SINGLE_VECTOR_LANES == 0, "single lanes are processed a vector at a time");
+
+// set by --precision single, kernels compiled after it run over floats
+static bool single_precision;
+
+static uint16_t kernel_new_reg(Kernel *kernel, const char **error){
+	if (kernel->reg_count == KERNEL_CAPACITY){
+		*error = "expression too long to compile";
+		return 0;
+	}
+	kernel->reg_count += 1;
+	return kernel->reg_count - 1;
+}
+
+static uint16_t kernel_operand(Kernel *kernel, Value value, const char **error){
+	if (value.type == DT_Lanes) return value.reg;
+	demote_bigs(&value, 1);
+	demote_decimals(&value, 1);
+	if (value.type == DT_Fixed) value = REAL_VALUE(fixed_to_double(value.integer));
+	if (value.type != DT_Real){
+		*error = "wrong data type";
+		return 0;
+	}
+	uint16_t reg = kernel_new_reg(kernel, error);
+	kernel->consts[kernel->const_count] = (KernelConstant){reg, value.real};
+	kernel->const_count += 1;
+	return reg;
+}
+
+static bool is_random_op(KernelOpcode code){
+	return KO_Rand <= code && code <= KO_Randexp;
+}
+
+static Value kernel_emit(Kernel *kernel, KernelOpcode code, const Value *args, size_t arg_count){
+	const char *error = NULL;
+	KernelOp op = {.code = code};
+	for (size_t i=0; i!=arg_count; i+=1) op.args[i] = kernel_operand(kernel, args[i], &error);
+	op.dst = kernel_new_reg(kernel, &error);
+	if (is_random_op(code)){
+		op.stream = kernel->stream_count;
+		if (kernel->stream_count == UINT8_MAX) error = "too many random numbers in expression";
+		kernel->stream_count += 1;
+	}
+	if (error != NULL) return ERROR_VALUE(error, 0);
+	kernel->ops[kernel->op_count] = op;
+	kernel->op_count += 1;
+	return (Value){.type = DT_Lanes, .reg = op.dst};
+}
+
+// registers of one worker, with the constants already in place
+static Lanes *kernel_registers(const Kernel *kernel){
+	Lanes *regs = checked_malloc(kernel->reg_count * sizeof(Lanes));
+	for (size_t i=0; i!=kernel->const_count; i+=1){
+		for (size_t l=0; l!=KERNEL_LANES; l+=1) regs[kernel->consts[i].reg][l] = kernel->consts[i].value;
+	}
+	return regs;
+}
+
+static SingleLanes *kernel_registers_single(const Kernel *kernel){
+	SingleLanes *regs = checked_malloc(kernel->reg_count * sizeof(SingleLanes));
+	for (size_t i=0; i!=kernel->const_count; i+=1){
+		for (size_t l=0; l!=KERNEL_LANES; l+=1) regs[kernel->consts[i].reg][l] = (float)kernel->consts[i].value;
+	}
+	return regs;
+}
+
+#define FOR_LANES(expr) for (size_t l=0; l!=KERNEL_LANES; l+=1) d[l] = (expr); break
+
+// Evaluates the lanes first..first+KERNEL_LANES. Every op is a loop over all
+// lanes, so the interpreter overhead is paid once per batch and the simple ops
+// compile to vector instructions.
+static void run_kernel(const Kernel *kernel, Lanes *regs, uint64_t seed, uint64_t stream_base, uint64_t first){
+	for (size_t i=0; i!=kernel->op_count; i+=1){
+		const KernelOp *op = kernel->ops + i;
+		double *restrict d = regs[op->dst];
+		const double *a = regs[op->args[0]];
+		const double *b = regs[op->args[1]];
+		const double *c = regs[op->args[2]];
+		if (is_random_op(op->code)){
+			if (op->code == KO_Randn)
+				random_fill_normal(seed, stream_base + op->stream, first, d, KERNEL_LANES);
+			else
+				random_fill(seed, stream_base + op->stream, first, d, KERNEL_LANES);
+		}
+		switch (op->code){
+		case KO_Negate:       FOR_LANES(-a[l]);
+		case KO_Add:          FOR_LANES(a[l] + b[l]);
+		case KO_Subtract:     FOR_LANES(a[l] - b[l]);
+		case KO_Multiply:     FOR_LANES(a[l] * b[l]);
+		case KO_Divide:       FOR_LANES(a[l] / b[l]);
+		case KO_Power:        FOR_LANES(pow(a[l], b[l]));
+		case KO_Factorial:    FOR_LANES(tgamma(1.0 + a[l]));
+		case KO_Less:         FOR_LANES((double)(a[l] < b[l]));
+		case KO_LessEqual:    FOR_LANES((double)(a[l] <= b[l]));
+		case KO_Greater:      FOR_LANES((double)(a[l] > b[l]));
+		case KO_GreaterEqual: FOR_LANES((double)(a[l] >= b[l]));
+		case KO_Equal:        FOR_LANES((double)(a[l] == b[l]));
+		case KO_NotEqual:     FOR_LANES((double)(a[l] != b[l]));
+		case KO_And:          FOR_LANES((double)((a[l] != 0.0) & (b[l] != 0.0)));
+		case KO_Or:           FOR_LANES((double)((a[l] != 0.0) | (b[l] != 0.0)));
+		case KO_Select:       FOR_LANES(a[l] != 0.0 ? b[l] : c[l]);
+		case KO_Sqrt:         FOR_LANES(sqrt(a[l]));
+		case KO_Log:          FOR_LANES(log(a[l]));
+		case KO_Exp:          FOR_LANES(exp(a[l]));
+		case KO_Sin:          FOR_LANES(sin(a[l]));
+		case KO_Cos:          FOR_LANES(cos(a[l]));
+		case KO_Tan:          FOR_LANES(tan(a[l]));
+		case KO_Abs:          FOR_LANES(fabs(a[l]));
+		case KO_Percent:      FOR_LANES(a[l] / 100.0);
+		case KO_Randu:        FOR_LANES(a[l] + (b[l] - a[l])*d[l]);
+		case KO_Randint:      FOR_LANES(floor(a[l] + (b[l] - a[l] + 1.0)*d[l]));
+		case KO_Randexp:      FOR_LANES(-log1p(-d[l]) / a[l]);
+		default: break;
+		}
+	}
+}
+
+// run_kernel over floats, the same random streams give other numbers
+static void run_kernel_single(const Kernel *kernel, SingleLanes *regs, uint64_t seed, uint64_t stream_base, uint64_t first){
+	for (size_t i=0; i!=kernel->op_count; i+=1){
+		const KernelOp *op = kernel->ops + i;
+		float *restrict d = regs[op->dst];
+		const float *a = regs[op->args[0]];
+		const float *b = regs[op->args[1]];
+		const float *c = regs[op->args[2]];
+		if (is_random_op(op->code)){
+			if (op->code == KO_Randn)
+				random_fill_normal_single(seed, stream_base + op->stream, first, d, KERNEL_LANES);
+			else
+				random_fill_single(seed, stream_base + op->stream, first, d, KERNEL_LANES);
+		}
+		switch (op->code){
+		case KO_Negate:       FOR_LANES(-a[l]);
+		case KO_Add:          FOR_LANES(a[l] + b[l]);
+		case KO_Subtract:     FOR_LANES(a[l] - b[l]);
+		case KO_Multiply:     FOR_LANES(a[l] * b[l]);
+		case KO_Divide:       FOR_LANES(a[l] / b[l]);
+		case KO_Power:
+			single_pow_lanes(d, a, b, KERNEL_LANES);
+			break;
+		case KO_Factorial:
+			single_factorial_lanes(d, a, KERNEL_LANES);
+			break;
+		case KO_Less:         FOR_LANES((float)(a[l] < b[l]));
+		case KO_LessEqual:    FOR_LANES((float)(a[l] <= b[l]));
+		case KO_Greater:      FOR_LANES((float)(a[l] > b[l]));
+		case KO_GreaterEqual: FOR_LANES((float)(a[l] >= b[l]));
+		case KO_Equal:        FOR_LANES((float)(a[l] == b[l]));
+		case KO_NotEqual:     FOR_LANES((float)(a[l] != b[l]));
+		case KO_And:          FOR_LANES((float)((a[l] != 0.0f) & (b[l] != 0.0f)));
+		case KO_Or:           FOR_LANES((float)((a[l] != 0.0f) | (b[l] != 0.0f)));
+		case KO_Select:       FOR_LANES(a[l] != 0.0f ? b[l] : c[l]);
+		case KO_Sqrt:         FOR_LANES(sqrtf(a[l]));
+		case KO_Log:
+			single_log_lanes(d, a, KERNEL_LANES);
+			break;
+		case KO_Exp:
+			single_exp_lanes(d, a, KERNEL_LANES);
+			break;
+		case KO_Sin:          FOR_LANES(sinf(a[l]));
+		case KO_Cos:          FOR_LANES(cosf(a[l]));
+		case KO_Tan:          FOR_LANES(tanf(a[l]));
+		case KO_Abs:          FOR_LANES(fabsf(a[l]));
+		case KO_Percent:      FOR_LANES(a[l] / 100.0f);
+		case KO_Randu:        FOR_LANES(a[l] + (b[l] - a[l])*d[l]);
+		case KO_Randint:      FOR_LANES(floorf(a[l] + (b[l] - a[l] + 1.0f)*d[l]));
+		case KO_Randexp:      FOR_LANES(-log1pf(-d[l]) / a[l]);
+		default: break;
+		}
+	}
+}
+
+#undef FOR_LANES
+
+static double digamma(double x){
+	if (x <= 0.0 && x == floor(x)) return NAN;
+	if (x < 0.0) return digamma(1.0 - x) - M_PI / tan(M_PI * x);
+	double res = 0.0;
+	for (; x<6.0; x+=1.0) res -= 1.0 / x;
+	double f = 1.0 / (x*x);
+	return res + log(x) - 0.5/x - f*(1.0/12 - f*(1.0/120 - f*(1.0/252 - f*(1.0/240 - f/132))));
+}
+
+#define FOR_LANES(expr) for (size_t l=0; l!=KERNEL_LANES; l+=1) dt[l] = (expr); break
+
+// t*x, zero for a zero tangent, so a derivative that is infinite where its
+// input does not change, like sqrt(x) at 0 for a data column, adds nothing
+static inline double tangent_term(double t, double x){
+	return t != 0.0 ? t*x : 0.0;
+}
+
+// Forward mode differentiation of a kernel that already ran on regs. The
+// tangents of the variables are set by the caller, every op then writes the
+// derivative of its register along that direction, random numbers and
+// comparisons have none.
+static void run_kernel_tangent(const Kernel *kernel, const Lanes *regs, Lanes *tangents){
+	for (size_t i=0; i!=kernel->op_count; i+=1){
+		const KernelOp *op = kernel->ops + i;
+		const double *d = regs[op->dst];
+		const double *a = regs[op->args[0]];
+		const double *b = regs[op->args[1]];
+		double *restrict dt = tangents[op->dst];
+		const double *at = tangents[op->args[0]];
+		const double *bt = tangents[op->args[1]];
+		const double *ct = tangents[op->args[2]];
+		switch (op->code){
+		case KO_Negate:   FOR_LANES(-at[l]);
+		case KO_Add:      FOR_LANES(at[l] + bt[l]);
+		case KO_Subtract: FOR_LANES(at[l] - bt[l]);
+		case KO_Multiply: FOR_LANES(tangent_term(at[l], b[l]) + tangent_term(bt[l], a[l]));
+		case KO_Divide:   FOR_LANES(tangent_term(at[l], 1.0/b[l]) - tangent_term(bt[l], d[l]/b[l]));
+		case KO_Power:
+			FOR_LANES(tangent_term(at[l], b[l]*pow(a[l], b[l] - 1.0)) + tangent_term(bt[l], d[l] != 0.0 ? d[l]*log(a[l]) : 0.0));
+		case KO_Factorial: FOR_LANES(tangent_term(at[l], d[l]*digamma(1.0 + a[l])));
+		case KO_Select:   FOR_LANES(a[l] != 0.0 ? bt[l] : ct[l]);
+		case KO_Sqrt:     FOR_LANES(tangent_term(at[l], 0.5/d[l]));
+		case KO_Log:      FOR_LANES(tangent_term(at[l], 1.0/a[l]));
+		case KO_Exp:      FOR_LANES(tangent_term(at[l], d[l]));
+		case KO_Sin:      FOR_LANES(tangent_term(at[l], cos(a[l])));
+		case KO_Cos:      FOR_LANES(tangent_term(at[l], -sin(a[l])));
+		case KO_Tan:      FOR_LANES(tangent_term(at[l], 1.0 + d[l]*d[l]));
+		case KO_Abs:      FOR_LANES(tangent_term(at[l], (double)((a[l] > 0.0) - (a[l] < 0.0))));
+		case KO_Percent:  FOR_LANES(at[l] / 100.0);
+		default:          FOR_LANES(0.0);
+		}
+	}
+}
+
+#undef FOR_LANES
+
+
+typedef struct Function{
+	uint8_t arg_count;
+	const char *arg_types;
+	Value (*call)(const Value *args, Stream *stream);
+	KernelOpcode kernel_op;
+	const char *form;
+} Function;
+
+static Value fn_sqrt(const Value *args, Stream *stream){
+	if (args[0].real < 0.0) return ERROR_VALUE("square root of negative number", 0);
+	return REAL_VALUE(sqrt(args[0].real));
+}
+
+static Value fn_log(const Value *args, Stream *stream){
+	if (args[0].real <= 0.0) return ERROR_VALUE("logarithm of non positive number", 0);
+	return REAL_VALUE(log(args[0].real));
+}
+
+static Value fn_exp(const Value *args, Stream *stream){ return REAL_VALUE(exp(args[0].real)); }
+static Value fn_sin(const Value *args, Stream *stream){ return REAL_VALUE(sin(args[0].real)); }
+static Value fn_cos(const Value *args, Stream *stream){ return REAL_VALUE(cos(args[0].real)); }
+static Value fn_tan(const Value *args, Stream *stream){ return REAL_VALUE(tan(args[0].real)); }
+static Value fn_abs(const Value *args, Stream *stream){ return REAL_VALUE(fabs(args[0].real)); }
+
+static Value fn_pow(const Value *args, Stream *stream){
+	if (args[0].real < 0.0) return ERROR_VALUE("negative power base", 0);
+	return REAL_VALUE(pow(args[0].real, args[1].real));
+}
+
+static Value fn_percent(const Value *args, Stream *stream){
+	return REAL_VALUE(args[0].real / 100.0);
+}
+
+static Value fn_if(const Value *args, Stream *stream){
+	return REAL_VALUE(select_real(args[0].real, args[1].real, args[2].real));
+}
+
+static Random rng;
+
+static Value fn_rand(const Value *args, Stream *stream){
+	return REAL_VALUE(random_uniform(&rng));
+}
+
+static Value fn_randn(const Value *args, Stream *stream){
+	return REAL_VALUE(random_normal(&rng));
+}
+
+static Value fn_randu(const Value *args, Stream *stream){
+	double lo = args[0].real;
+	double hi = args[1].real;
+	if (!(lo <= hi)) return ERROR_VALUE("empty range", 0);
+	return REAL_VALUE(lo + (hi - lo)*random_uniform(&rng));
+}
+
+static Value fn_randint(const Value *args, Stream *stream){
+	double lo = args[0].real;
+	double hi = args[1].real;
+	if (lo != floor(lo) || hi != floor(hi)) return ERROR_VALUE("bounds must be integers", 0);
+	if (!(lo <= hi)) return ERROR_VALUE("empty range", 0);
+	return REAL_VALUE(floor(lo + (hi - lo + 1.0)*random_uniform(&rng)));
+}
+
+static Value fn_randexp(const Value *args, Stream *stream){
+	if (!(args[0].real > 0.0)) return ERROR_VALUE("rate must be positive", 0);
+	return REAL_VALUE(-log1p(-random_uniform(&rng)) / args[0].real);
+}
+
+// streams after the first one are handed out to kernels, every run takes
+// fresh ones so that two runs never see the same numbers
+static uint64_t kernel_streams = 1;
+
+#define MONTECARLO_CHUNK (1 << 16)
+#define MONTECARLO_MAX_SAMPLES (1ull << 48)
+
+typedef struct MonteCarlo{
+	const Kernel *kernel;
+	uint64_t seed;
+	uint64_t stream_base;
+	uint64_t samples;
+	double *means;
+	double *squares;
+} MonteCarlo;
+
+// Sums of one chunk are taken relative to its first sample, which keeps the
+// sum of squares from cancelling when the variance is small next to the mean.
+// Every lane has its own accumulators, so the loop stays vectorized.
+static void montecarlo_chunk(size_t index, void *data){
+	MonteCarlo *mc = data;
+	const Kernel *kernel = mc->kernel;
+	Lanes *regs = kernel->single ? NULL : kernel_registers(kernel);
+	SingleLanes *singles = kernel->single ? kernel_registers_single(kernel) : NULL;
+	Lanes widened;
+	uint64_t first = (uint64_t)index * MONTECARLO_CHUNK;
+	uint64_t end = first + MONTECARLO_CHUNK < mc->samples ? first + MONTECARLO_CHUNK : mc->samples;
+
+	double shift = 0.0;
+	Lanes sums = {0};
+	Lanes squares = {0};
+	for (uint64_t batch=first; batch<end; batch+=KERNEL_LANES){
+		const double *res = widened;
+		if (singles != NULL){
+			for (size_t v=0; v!=kernel->var_count; v+=1)
+				random_fill_single(mc->seed, mc->stream_base + kernel->stream_count + v, batch, singles[v], KERNEL_LANES);
+			run_kernel_single(kernel, singles, mc->seed, mc->stream_base, batch);
+			for (size_t l=0; l!=KERNEL_LANES; l+=1) widened[l] = singles[kernel->result][l];
+		} else{
+			for (size_t v=0; v!=kernel->var_count; v+=1)
+				random_fill(mc->seed, mc->stream_base + kernel->stream_count + v, batch, regs[v], KERNEL_LANES);
+			run_kernel(kernel, regs, mc->seed, mc->stream_base, batch);
+			res = regs[kernel->result];
+		}
+		if (batch == first) shift = res[0];
+		size_t valid = end - batch;
+		for (size_t l=0; l!=KERNEL_LANES; l+=1){
+			double d = l < valid ? res[l] - shift : 0.0;
+			sums[l] += d;
+			squares[l] += d*d;
+		}
+	}
+	double sum = 0.0;
+	double square = 0.0;
+	for (size_t l=0; l!=KERNEL_LANES; l+=1){
+		sum += sums[l];
+		square += squares[l];
+	}
+	double count = (double)(end - first);
+	mc->means[index] = shift + sum/count;
+	mc->squares[index] = square - sum*sum/count;
+	free(regs);
+	free(singles);
+}
+
+// montecarlo(expr, vars..., n), every variable is uniform on [0, 1), returns
+// the mean of expr and its standard error
+static Value fn_montecarlo(const Value *args, Stream *stream){
+	const Kernel *kernel = args[0].kernel;
+	Value n = args[kernel->var_count + 1];
+	if (n.type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+	if (!(2.0 <= n.real && n.real <= MONTECARLO_MAX_SAMPLES) || n.real != floor(n.real))
+		return ERROR_VALUE("sample count must be an integer of at least 2", 0);
+
+	MonteCarlo mc = {
+		.kernel = kernel, .seed = rng.seed, .stream_base = kernel_streams, .samples = (uint64_t)n.real
+	};
+	kernel_streams += kernel->stream_count + kernel->var_count;
+	size_t chunk_count = (mc.samples + MONTECARLO_CHUNK-1) / MONTECARLO_CHUNK;
+	mc.means = checked_malloc(chunk_count * sizeof(double));
+	mc.squares = checked_malloc(chunk_count * sizeof(double));
+	parallel_for(chunk_count, montecarlo_chunk, &mc);
+
+	// chunks are merged in order, so the result does not depend on the threads
+	double count = 0.0;
+	double mean = 0.0;
+	double square = 0.0;
+	for (size_t i=0; i!=chunk_count; i+=1){
+		double chunk = (double)(i+1 == chunk_count ? mc.samples - i*(uint64_t)MONTECARLO_CHUNK : MONTECARLO_CHUNK);
+		double delta = mc.means[i] - mean;
+		double total = count + chunk;
+		mean += delta * chunk/total;
+		square += mc.squares[i] + delta*delta * count*chunk/total;
+		count = total;
+	}
+	free(mc.means);
+	free(mc.squares);
+
+	Value res = make_vector(2);
+	res.reals[0] = mean;
+	res.reals[1] = sqrt(square / (count - 1.0) / count);
+	return res;
+}
+
+#define RENDER_BAND 8
+#define RENDER_MAX_SIZE (1 << 15)
+
+typedef struct Render{
+	const Kernel *kernel;
+	uint64_t seed;
+	uint64_t stream_base;
+	size_t width, height;
+	double x0, dx, y0, dy;
+	double *values;
+} Render;
+
+// a band of rows, every row in batches of lanes, pixels are sampled at their
+// centers and rows go from the top of the range down
+static void render_band(size_t index, void *data){
+	Render *r = data;
+	const Kernel *kernel = r->kernel;
+	Lanes *regs = kernel->single ? NULL : kernel_registers(kernel);
+	SingleLanes *singles = kernel->single ? kernel_registers_single(kernel) : NULL;
+	size_t stride = (r->width + KERNEL_LANES-1) / KERNEL_LANES * KERNEL_LANES;
+	size_t end = (index + 1) * RENDER_BAND < r->height ? (index + 1) * RENDER_BAND : r->height;
+	for (size_t row=index*RENDER_BAND; row!=end; row+=1){
+		for (size_t col=0; col<r->width; col+=KERNEL_LANES){
+			size_t valid = r->width - col < KERNEL_LANES ? r->width - col : KERNEL_LANES;
+			double *values = r->values + row*r->width + col;
+			if (singles != NULL){
+				for (size_t l=0; l!=KERNEL_LANES; l+=1){
+					singles[0][l] = r->x0 + ((double)(col + l) + 0.5) * r->dx;
+					singles[1][l] = r->y0 - ((double)row + 0.5) * r->dy;
+				}
+				run_kernel_single(kernel, singles, r->seed, r->stream_base, row*stride + col);
+				for (size_t l=0; l!=valid; l+=1) values[l] = singles[kernel->result][l];
+				continue;
+			}
+			for (size_t l=0; l!=KERNEL_LANES; l+=1){
+				regs[0][l] = r->x0 + ((double)(col + l) + 0.5) * r->dx;
+				regs[1][l] = r->y0 - ((double)row + 0.5) * r->dy;
+			}
+			run_kernel(kernel, regs, r->seed, r->stream_base, row*stride + col);
+			memcpy(values, regs[kernel->result], valid * sizeof(double));
+		}
+	}
+	free(regs);
+	free(singles);
+}
+
+// viridis at nine evenly spaced points
+static const uint8_t render_colors[9][3] = {
+	{68, 1, 84}, {71, 44, 122}, {59, 81, 139}, {44, 113, 142}, {33, 144, 141},
+	{39, 173, 129}, {92, 200, 99}, {170, 220, 50}, {253, 231, 37},
+};
+
+// render(expr, x, x0, x1, y, y0, y1, width, height, "out.pgm") writes expr over
+// the rectangle as a grayscale PGM image, or in color when the name ends in
+// .ppm. Values are scaled from the smallest to the largest finite one, which
+// are returned, anything else is black.
+static Value fn_render(const Value *args, Stream *stream){
+	const Kernel *kernel = args[0].kernel;
+	for (size_t i=2; i!=9; i+=1){
+		if (i != 4 && args[i].type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+	}
+	double w = args[7].real, h = args[8].real;
+	if (!(w >= 1.0 && w <= RENDER_MAX_SIZE && w == floor(w) && h >= 1.0 && h <= RENDER_MAX_SIZE && h == floor(h)))
+		return ERROR_VALUE("bad image size", 0);
+	const char *path = args[9].string;
+	size_t path_size = strlen(path);
+	bool color = path_size >= 4 && strcmp(path + path_size - 4, ".ppm") == 0;
+
+	Render r = {
+		.kernel = kernel, .seed = rng.seed, .stream_base = kernel_streams,
+		.width = (size_t)w, .height = (size_t)h,
+		.x0 = args[2].real, .dx = (args[3].real - args[2].real) / w,
+		.y0 = args[6].real, .dy = (args[6].real - args[5].real) / h,
+	};
+	kernel_streams += kernel->stream_count;
+	size_t count = r.width * r.height;
+	r.values = checked_malloc(count * sizeof(double));
+	parallel_for((r.height + RENDER_BAND-1) / RENDER_BAND, render_band, &r);
+
+	double lo = INFINITY, hi = -INFINITY;
+	for (size_t i=0; i!=count; i+=1){
+		double v = r.values[i];
+		if (isfinite(v)){
+			lo = v < lo ? v : lo;
+			hi = v > hi ? v : hi;
+		}
+	}
+	size_t channels = color ? 3 : 1;
+	uint8_t *pixels = checked_malloc(count * channels);
+	double scale = hi > lo ? 1.0 / (hi - lo) : 0.0;
+	for (size_t i=0; i!=count; i+=1){
+		double v = r.values[i];
+		double t = isfinite(v) ? (v - lo) * scale : -1.0;
+		if (!color){
+			pixels[i] = t < 0.0 ? 0 : (uint8_t)(t * 255.0 + 0.5);
+			continue;
+		}
+		uint8_t *p = pixels + 3*i;
+		if (t < 0.0){
+			p[0] = p[1] = p[2] = 0;
+			continue;
+		}
+		size_t k = t >= 1.0 ? 7 : (size_t)(t * 8.0);
+		double f = t * 8.0 - (double)k;
+		for (size_t c=0; c!=3; c+=1)
+			p[c] = (uint8_t)(render_colors[k][c] + f * (render_colors[k+1][c] - render_colors[k][c]) + 0.5);
+	}
+	free(r.values);
+
+	FILE *file = fopen(path, "wb");
+	bool written = file != NULL;
+	if (written){
+		fprintf(file, "P%c\n%zu %zu\n255\n", color ? '6' : '5', r.width, r.height);
+		written = fwrite(pixels, channels, count, file) == count;
+		written &= fclose(file) == 0;
+	}
+	free(pixels);
+	if (!written) return ERROR_VALUE("cannot write file", 0);
+
+	Value res = make_vector(2);
+	res.reals[0] = isfinite(lo) ? lo : NAN;
+	res.reals[1] = isfinite(hi) ? hi : NAN;
+	return res;
+}
+
+#define SAMPLE_INITIAL 32
+#define SAMPLE_MAX_LEVELS 24
+#define SAMPLE_MAX_POINTS (1 << 22)
+#define SAMPLE_TASK (16 * KERNEL_LANES)
+
+// the points of one refinement level, each task evaluates SAMPLE_TASK of them
+typedef struct Sample{
+	const Kernel *kernel;
+	uint64_t seed;
+	uint64_t stream_base;
+	uint64_t first;
+	const double *x;
+	double *y;
+	size_t count;
+} Sample;
+
+static void sample_task(size_t index, void *data){
+	Sample *s = data;
+	Lanes *regs = kernel_registers(s->kernel);
+	size_t end = (index + 1) * SAMPLE_TASK < s->count ? (index + 1) * SAMPLE_TASK : s->count;
+	for (size_t batch=index*SAMPLE_TASK; batch<end; batch+=KERNEL_LANES){
+		size_t valid = end - batch < KERNEL_LANES ? end - batch : KERNEL_LANES;
+		for (size_t l=0; l!=KERNEL_LANES; l+=1) regs[0][l] = s->x[batch + (l < valid ? l : 0)];
+		run_kernel(s->kernel, regs, s->seed, s->stream_base, s->first + batch);
+		memcpy(s->y + batch, regs[s->kernel->result], valid * sizeof(double));
+	}
+	free(regs);
+}
+
+static bool sample_refine(double left, double middle, double right, double limit){
+	int finite = isfinite(left) + isfinite(middle) + isfinite(right);
+	if (finite != 3) return finite != 0;
+	return fabs(middle - 0.5*(left + right)) > limit;
+}
+
+// sample(expr, x, a, b, tol) returns points [x0, y0, x1, y1, ...] of expr from
+// a to b in increasing x. Every level evaluates the midpoints of the intervals
+// of the last one in one batch, and an interval is split again when its
+// midpoint is further than tol times the range of the values from the chord,
+// or when it has a finite and a non-finite point.
+static Value fn_sample(const Value *args, Stream *stream){
+	const Kernel *kernel = args[0].kernel;
+	if (args[2].type != DT_Real || args[3].type != DT_Real || args[4].type != DT_Real)
+		return ERROR_VALUE("wrong data type", 0);
+	double a = args[2].real, b = args[3].real, tol = args[4].real;
+	if (!(a < b) || !isfinite(b - a)) return ERROR_VALUE("empty range", 0);
+	if (!(tol > 0.0)) return ERROR_VALUE("tolerance must be positive", 0);
+
+	size_t capacity = 4 * SAMPLE_INITIAL;
+	double *xs = checked_malloc(capacity * sizeof(double));
+	double *ys = checked_malloc(capacity * sizeof(double));
+	uint32_t *intervals = checked_malloc(2 * capacity * sizeof(uint32_t));
+	uint32_t *next = checked_malloc(2 * capacity * sizeof(uint32_t));
+	Sample s = {.kernel = kernel, .seed = rng.seed, .stream_base = kernel_streams};
+	kernel_streams += kernel->stream_count;
+
+	s.count = SAMPLE_INITIAL + 1;
+	for (size_t i=0; i!=s.count; i+=1) xs[i] = a + (b - a) * (double)i / SAMPLE_INITIAL;
+	xs[SAMPLE_INITIAL] = b;
+	size_t point_count = 0;
+	size_t interval_count = SAMPLE_INITIAL;
+	for (size_t i=0; i!=SAMPLE_INITIAL; i+=1){
+		intervals[2*i] = i;
+		intervals[2*i + 1] = i + 1;
+	}
+	double lo = INFINITY, hi = -INFINITY;
+	for (size_t level=0; ; level+=1){
+		s.x = xs + point_count;
+		s.y = ys + point_count;
+		s.first = point_count;
+		parallel_for((s.count + SAMPLE_TASK-1) / SAMPLE_TASK, sample_task, &s);
+		for (size_t i=0; i!=s.count; i+=1){
+			if (isfinite(s.y[i])){
+				lo = s.y[i] < lo ? s.y[i] : lo;
+				hi = s.y[i] > hi ? s.y[i] : hi;
+			}
+		}
+		point_count += s.count;
+		if (level == SAMPLE_MAX_LEVELS || point_count + interval_count > SAMPLE_MAX_POINTS) break;
+
+		// the midpoint of interval i is the point point_count + i
+		if (level != 0){
+			size_t kept = 0;
+			double limit = tol * (hi - lo);
+			for (size_t i=0; i!=interval_count; i+=1){
+				uint32_t l = intervals[2*i], r = intervals[2*i + 1], m = point_count - s.count + i;
+				if (!sample_refine(ys[l], ys[m], ys[r], limit)) continue;
+				next[4*kept] = l;
+				next[4*kept + 1] = m;
+				next[4*kept + 2] = m;
+				next[4*kept + 3] = r;
+				kept += 1;
+			}
+			uint32_t *t = intervals;
+			intervals = next;
+			next = t;
+			interval_count = 2 * kept;
+		}
+		if (interval_count == 0) break;
+		if (point_count + interval_count > capacity){
+			while (point_count + interval_count > capacity) capacity *= 2;
+			xs = realloc(xs, capacity * sizeof(double));
+			ys = realloc(ys, capacity * sizeof(double));
+			intervals = realloc(intervals, 2 * capacity * sizeof(uint32_t));
+			next = realloc(next, 2 * capacity * sizeof(uint32_t));
+			if (xs == NULL || ys == NULL || intervals == NULL || next == NULL){
+				fprintf(stderr, "ERROR: out of memory\n");
+				exit(1);
+			}
+		}
+		for (size_t i=0; i!=interval_count; i+=1)
+			xs[point_count + i] = 0.5 * (xs[intervals[2*i]] + xs[intervals[2*i + 1]]);
+		s.count = interval_count;
+	}
+	free(intervals);
+	free(next);
+
+	uint64_t *keys = checked_malloc(point_count * sizeof(uint64_t));
+	uint32_t *order = checked_malloc(point_count * sizeof(uint32_t));
+	sort_keys(keys, xs, point_count);
+	for (size_t i=0; i!=point_count; i+=1) order[i] = i;
+	radix_sort(keys, order, point_count);
+	Value res = make_vector(2 * point_count);
+	for (size_t i=0; i!=point_count; i+=1){
+		res.reals[2*i] = xs[order[i]];
+		res.reals[2*i + 1] = ys[order[i]];
+	}
+	free(order);
+	free(keys);
+	free(xs);
+	free(ys);
+	return res;
+}
+
+#define ODE_MAX_STEPS 1000000
+#define ODE_TOLERANCE 1e-9
+#define ODE_FIRST_STEP 1e-3
+
+// Dormand-Prince 5(4), the last stage is evaluated at the new solution, so it
+// is the first stage of the next step
+static const double ode_c[7] = {0.0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1.0, 1.0};
+static const double ode_a[7][6] = {
+	{0},
+	{1.0/5},
+	{3.0/40, 9.0/40},
+	{44.0/45, -56.0/15, 32.0/9},
+	{19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+	{9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+	{35.0/384, 0.0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84},
+};
+static const double ode_e[7] = {
+	71.0/57600, 0.0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40
+};
+
+typedef struct Ode{
+	const Kernel *kernels[KERNEL_VAR_CAPACITY];
+	size_t dim;
+	size_t count;
+	double t0, t1;
+	const double *y0;
+	double *res;
+	atomic_size_t failed;
+} Ode;
+
+// the state variables come first in every kernel, then the time
+static void ode_rhs(const Ode *ode, Lanes **regs, const Lanes *y, const double *t, Lanes *res){
+	for (size_t e=0; e!=ode->dim; e+=1){
+		for (size_t v=0; v!=ode->dim; v+=1) memcpy(regs[e][v], y[v], sizeof(Lanes));
+		memcpy(regs[e][ode->dim], t, sizeof(Lanes));
+		run_kernel(ode->kernels[e], regs[e], 0, 0, 0);
+		memcpy(res[e], regs[e][ode->kernels[e]->result], sizeof(Lanes));
+	}
+}
+
+// Every lane is a trajectory with its own time and step size, so a lane that
+// needs small steps does not hold back the others. Finished lanes keep
+// running with a zero step until the whole batch is done. A trajectory whose
+// step size collapses or that runs out of steps ends as NaNs.
+static void ode_batch(size_t index, void *data){
+	Ode *ode = data;
+	size_t dim = ode->dim;
+	size_t first = index * KERNEL_LANES;
+	size_t valid = ode->count - first < KERNEL_LANES ? ode->count - first : KERNEL_LANES;
+	Lanes *regs[KERNEL_VAR_CAPACITY];
+	for (size_t e=0; e!=dim; e+=1) regs[e] = kernel_registers(ode->kernels[e]);
+	Lanes *y = checked_malloc(9 * dim * sizeof(Lanes));
+	Lanes *ys = y + dim;
+	Lanes *k = ys + dim;
+
+	Lanes t, ts, h;
+	bool done[KERNEL_LANES], last[KERNEL_LANES];
+	bool failed[KERNEL_LANES] = {0};
+	double span = ode->t1 - ode->t0;
+	for (size_t l=0; l!=KERNEL_LANES; l+=1){
+		const double *y0 = ode->y0 + (first + (l < valid ? l : 0)) * dim;
+		for (size_t v=0; v!=dim; v+=1) y[v][l] = y0[v];
+		t[l] = ode->t0;
+		h[l] = span * ODE_FIRST_STEP;
+		done[l] = span == 0.0;
+	}
+	ode_rhs(ode, regs, y, t, k);
+
+	size_t remaining = span == 0.0 ? 0 : KERNEL_LANES;
+	for (size_t step=0; remaining!=0; step+=1){
+		if (step == ODE_MAX_STEPS){
+			for (size_t l=0; l!=KERNEL_LANES; l+=1) failed[l] = !done[l];
+			break;
+		}
+		for (size_t l=0; l!=KERNEL_LANES; l+=1){
+			last[l] = !done[l] && (t[l] + h[l] - ode->t1) * span >= 0.0;
+			if (last[l]) h[l] = ode->t1 - t[l];
+			if (done[l]) h[l] = 0.0;
+		}
+		for (size_t s=1; s!=7; s+=1){
+			for (size_t v=0; v!=dim; v+=1){
+				for (size_t l=0; l!=KERNEL_LANES; l+=1){
+					double sum = 0.0;
+					for (size_t j=0; j!=s; j+=1) sum += ode_a[s][j] * k[j*dim + v][l];
+					ys[v][l] = y[v][l] + h[l]*sum;
+				}
+			}
+			for (size_t l=0; l!=KERNEL_LANES; l+=1) ts[l] = t[l] + ode_c[s]*h[l];
+			ode_rhs(ode, regs, ys, ts, k + s*dim);
+		}
+		for (size_t l=0; l!=KERNEL_LANES; l+=1){
+			if (done[l]) continue;
+			double err = 0.0;
+			for (size_t v=0; v!=dim; v+=1){
+				double sum = 0.0;
+				for (size_t j=0; j!=7; j+=1) sum += ode_e[j] * k[j*dim + v][l];
+				double scale = ODE_TOLERANCE * (1.0 + fmax(fabs(y[v][l]), fabs(ys[v][l])));
+				err += (h[l]*sum/scale) * (h[l]*sum/scale);
+			}
+			err = sqrt(err / (double)dim);
+			bool accept = err <= 1.0;
+			if (accept){
+				t[l] = last[l] ? ode->t1 : t[l] + h[l];
+				for (size_t v=0; v!=dim; v+=1){
+					y[v][l] = ys[v][l];
+					k[v][l] = k[6*dim + v][l];
+				}
+				if (last[l]){
+					done[l] = true;
+					remaining -= 1;
+					continue;
+				}
+			}
+			double factor = err == 0.0 ? 5.0 : 0.9 * pow(err, -0.2);
+			if (!(factor >= 0.2)) factor = 0.2;
+			if (factor > (accept ? 5.0 : 1.0)) factor = accept ? 5.0 : 1.0;
+			h[l] *= factor;
+			if (!(fabs(h[l]) > 1e-15 * fabs(span))){
+				failed[l] = true;
+				done[l] = true;
+				remaining -= 1;
+			}
+		}
+	}
+	for (size_t l=0; l!=valid; l+=1){
+		for (size_t v=0; v!=dim; v+=1) ode->res[(first + l)*dim + v] = failed[l] ? NAN : y[v][l];
+		if (failed[l]) atomic_fetch_add(&ode->failed, 1);
+	}
+	free(y);
+	for (size_t e=0; e!=dim; e+=1) free(regs[e]);
+}
+
+// ode(f1, ..., y1, ..., t, t0, t1, y0) integrates y' = f(y, t) from t0 to t1
+// and returns the state at t1. Several trajectories are integrated at once
+// when y0 holds one initial state after another, the ones that fail give NaNs
+// and a single one that fails is an error.
+static Value fn_ode(const Value *args, Stream *stream){
+	size_t dim = 0;
+	while (args[dim].type == DT_Kernel) dim += 1;
+	if (dim == 0) return ERROR_VALUE("expected equations", 0);
+	Value t0 = args[2*dim + 1], t1 = args[2*dim + 2], y0 = args[2*dim + 3];
+	demote_bigs(&t0, 1);
+	demote_bigs(&t1, 1);
+	if (t0.type != DT_Real || t1.type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+	if (!isfinite(t0.real) || !isfinite(t1.real)) return ERROR_VALUE("time must be finite", 0);
+	if (y0.type == DT_Real && dim == 1){
+		double value = y0.real;
+		y0 = make_vector(1);
+		y0.reals[0] = value;
+	}
+	if (y0.type != DT_Vector || y0.length == 0 || y0.length % dim != 0)
+		return ERROR_VALUE("initial state must have a value for every variable", 0);
+
+	Ode ode = {.dim = dim, .count = y0.length / dim, .t0 = t0.real, .t1 = t1.real, .y0 = y0.reals};
+	for (size_t e=0; e!=dim; e+=1){
+		ode.kernels[e] = args[e].kernel;
+		if (ode.kernels[e]->stream_count != 0) return ERROR_VALUE("equations cannot draw random numbers", 0);
+	}
+	atomic_init(&ode.failed, 0);
+	Value res = make_vector(y0.length);
+	ode.res = res.reals;
+	parallel_for((ode.count + KERNEL_LANES-1) / KERNEL_LANES, ode_batch, &ode);
+	if (ode.count == 1 && atomic_load(&ode.failed) != 0) return ERROR_VALUE("step size too small or too many steps", 0);
+	if (dim == 1 && ode.count == 1) return REAL_VALUE(res.reals[0]);
+	return res;
+}
+
+#define FIT_CHUNK (1 << 14)
+#define FIT_MAX_ITERATIONS 200
+#define FIT_MAX_DAMPING 1e16
+
+// The normal equations J^T J and J^T r of one chunk of rows, or only the sum
+// of squared residuals when no Jacobian is needed. Chunks are summed in order,
+// so the fit does not depend on the threads.
+typedef struct Fit{
+	const Kernel *kernel;
+	const Dataset *data;
+	size_t param_count;
+	const double *params;
+	bool jacobian;
+	double *costs;
+	double *normals;
+} Fit;
+
+static void fit_chunk(size_t index, void *data){
+	Fit *fit = data;
+	const Kernel *kernel = fit->kernel;
+	const Dataset *d = fit->data;
+	size_t m = fit->param_count;
+	size_t target = d->column_count - 1;
+	Lanes *regs = kernel_registers(kernel);
+	Lanes *tangents = fit->jacobian ? checked_malloc(m * kernel->reg_count * sizeof(Lanes)) : NULL;
+	for (size_t j=0; j!=m; j+=1){
+		for (size_t l=0; l!=KERNEL_LANES; l+=1) regs[j][l] = fit->params[j];
+	}
+	size_t first = index * FIT_CHUNK;
+	size_t end = first + FIT_CHUNK < d->row_count ? first + FIT_CHUNK : d->row_count;
+	double cost = 0.0;
+	double *normals = fit->jacobian ? fit->normals + index * (m*m + m) : NULL;
+	if (normals != NULL) memset(normals, 0, (m*m + m) * sizeof(double));
+	Lanes jacobian[KERNEL_VAR_CAPACITY];
+
+	for (size_t batch=first; batch<end; batch+=KERNEL_LANES){
+		size_t valid = end - batch < KERNEL_LANES ? end - batch : KERNEL_LANES;
+		for (size_t c=0; c!=d->column_count; c+=1){
+			for (size_t l=0; l!=KERNEL_LANES; l+=1) regs[m + c][l] = d->columns[c][batch + (l < valid ? l : 0)];
+		}
+		run_kernel(kernel, regs, 0, 0, 0);
+		const double *model = regs[kernel->result];
+		for (size_t l=0; l!=valid; l+=1){
+			double r = model[l] - d->columns[target][batch + l];
+			cost += r*r;
+		}
+		if (normals == NULL) continue;
+		for (size_t j=0; j!=m; j+=1){
+			Lanes *t = tangents + j * kernel->reg_count;
+			memset(t, 0, kernel->reg_count * sizeof(Lanes));
+			for (size_t l=0; l!=KERNEL_LANES; l+=1) t[j][l] = 1.0;
+			run_kernel_tangent(kernel, regs, t);
+			memcpy(jacobian[j], t[kernel->result], sizeof(Lanes));
+		}
+		for (size_t l=0; l!=valid; l+=1){
+			double r = model[l] - d->columns[target][batch + l];
+			for (size_t a=0; a!=m; a+=1){
+				for (size_t b=0; b<=a; b+=1) normals[a*m + b] += jacobian[a][l] * jacobian[b][l];
+				normals[m*m + a] += jacobian[a][l] * r;
+			}
+		}
+	}
+	fit->costs[index] = cost;
+	free(tangents);
+	free(regs);
+}
+
+// sum of squared residuals at params, with the normal equations in normals
+// when it is not NULL
+static double fit_evaluate(Fit *fit, const double *params, double *normals){
+	size_t m = fit->param_count;
+	size_t chunk_count = (fit->data->row_count + FIT_CHUNK-1) / FIT_CHUNK;
+	fit->params = params;
+	fit->jacobian = normals != NULL;
+	parallel_for(chunk_count, fit_chunk, fit);
+	double cost = 0.0;
+	for (size_t i=0; i!=chunk_count; i+=1) cost += fit->costs[i];
+	if (normals != NULL){
+		memset(normals, 0, (m*m + m) * sizeof(double));
+		for (size_t i=0; i!=chunk_count; i+=1){
+			for (size_t k=0; k!=m*m + m; k+=1) normals[k] += fit->normals[i*(m*m + m) + k];
+		}
+	}
+	return cost;
+}
+
+// solves a*x = b in place for a symmetric positive definite a, of which only
+// the lower triangle is read
+static bool cholesky_solve(double *a, double *b, size_t n){
+	for (size_t j=0; j!=n; j+=1){
+		double diag = a[j*n + j];
+		for (size_t k=0; k!=j; k+=1) diag -= a[j*n + k] * a[j*n + k];
+		if (!(diag > 0.0)) return false;
+		a[j*n + j] = sqrt(diag);
+		for (size_t i=j+1; i!=n; i+=1){
+			double sum = a[i*n + j];
+			for (size_t k=0; k!=j; k+=1) sum -= a[i*n + k] * a[j*n + k];
+			a[i*n + j] = sum / a[j*n + j];
+		}
+	}
+	for (size_t i=0; i!=n; i+=1){
+		for (size_t k=0; k!=i; k+=1) b[i] -= a[i*n + k] * b[k];
+		b[i] /= a[i*n + i];
+	}
+	for (size_t i=n; i!=0; i-=1){
+		for (size_t k=i; k!=n; k+=1) b[i-1] -= a[k*n + i-1] * b[k];
+		b[i-1] /= a[(i-1)*n + i-1];
+	}
+	return true;
+}
+
+// fit(model, params..., "file.csv") fits the model to the last column of the
+// file by least squares with Levenberg-Marquardt and returns the parameters.
+// They start from their current values, or 1 when they have none.
+static Value fn_fit(const Value *args, Stream *stream){
+	const Kernel *kernel = args[0].kernel;
+	if (kernel->stream_count != 0) return ERROR_VALUE("model cannot draw random numbers", 0);
+	size_t m = 0;
+	while (args[m+1].type != DT_Data) m += 1;
+	if (m == 0) return ERROR_VALUE("expected parameters", 0);
+	const Dataset *d = args[m+1].dataset;
+
+	double params[KERNEL_VAR_CAPACITY], trial[KERNEL_VAR_CAPACITY];
+	for (size_t j=0; j!=m; j+=1) params[j] = args[j+1].type == DT_Real ? args[j+1].real : 1.0;
+	size_t chunk_count = (d->row_count + FIT_CHUNK-1) / FIT_CHUNK;
+	Fit fit = {.kernel = kernel, .data = d, .param_count = m};
+	fit.costs = checked_malloc(chunk_count * sizeof(double));
+	fit.normals = checked_malloc(chunk_count * (m*m + m) * sizeof(double));
+
+	double normals[KERNEL_VAR_CAPACITY * (KERNEL_VAR_CAPACITY + 1)];
+	double system[KERNEL_VAR_CAPACITY * KERNEL_VAR_CAPACITY];
+	double step[KERNEL_VAR_CAPACITY];
+	double cost = fit_evaluate(&fit, params, normals);
+	double damping = 1e-3;
+	bool finite = isfinite(cost);
+	bool accepted = false;
+	bool converged = cost == 0.0;
+	for (size_t iteration=0; finite && !converged && iteration!=FIT_MAX_ITERATIONS && damping<FIT_MAX_DAMPING; iteration+=1){
+		memcpy(system, normals, m*m * sizeof(double));
+		bool flat = true;
+		for (size_t j=0; j!=m; j+=1){
+			double diag = normals[j*m + j];
+			system[j*m + j] = diag + damping * (diag > 0.0 ? diag : 1.0);
+			step[j] = -normals[m*m + j];
+			flat &= step[j] == 0.0;
+		}
+		if (flat){
+			converged = true;
+			break;
+		}
+		if (!cholesky_solve(system, step, m)){
+			damping *= 10.0;
+			continue;
+		}
+		double size = 0.0, scale = 0.0;
+		for (size_t j=0; j!=m; j+=1){
+			trial[j] = params[j] + step[j];
+			size += step[j]*step[j];
+			scale += params[j]*params[j];
+		}
+		double trial_cost = fit_evaluate(&fit, trial, NULL);
+		if (!(trial_cost < cost)){
+			damping *= 10.0;
+			continue;
+		}
+		converged = cost - trial_cost <= 1e-12 * cost || size <= 1e-24 * (scale + 1e-24);
+		accepted = true;
+		memcpy(params, trial, m * sizeof(double));
+		cost = trial_cost;
+		damping = fmax(damping / 10.0, 1e-12);
+		if (converged) break;
+		cost = fit_evaluate(&fit, params, normals);
+	}
+	free(fit.costs);
+	free(fit.normals);
+	if (!finite) return ERROR_VALUE("model is not finite at the starting parameters", 0);
+	if (!accepted && !converged) return ERROR_VALUE("no step improved on the starting parameters", 0);
+
+	Value res = make_vector(m);
+	memcpy(res.reals, params, m * sizeof(double));
+	return res;
+}
+
+// column("file.csv", k) is the k-th column of the file as a vector, counted from 1
+static Value fn_column(const Value *args, Stream *stream){
+	const Dataset *d = args[0].dataset;
+	Value index = args[1];
+	demote_bigs(&index, 1);
+	if (index.type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+	double k = index.real;
+	if (!(k >= 1.0 && k <= (double)d->column_count && k == floor(k))) return ERROR_VALUE("no such column", 0);
+	Value res = make_vector(d->row_count);
+	memcpy(res.reals, d->columns[(size_t)k - 1], d->row_count * sizeof(double));
+	return res;
+}
+
+static Value fn_movsum(const Value *args, Stream *stream){
+	const char *error;
+	Window *w = get_window(stream, WK_Sum, args[1].real, &error);
+	if (w == NULL) return ERROR_VALUE(error, 0);
+	return REAL_VALUE(window_push_sum(w, args[0].real));
+}
+
+static Value fn_movavg(const Value *args, Stream *stream){
+	const char *error;
+	Window *w = get_window(stream, WK_Sum, args[1].real, &error);
+	if (w == NULL) return ERROR_VALUE(error, 0);
+	double sum = window_push_sum(w, args[0].real);
+	return REAL_VALUE(sum / (double)(w->count < w->size ? w->count : w->size));
+}
+
+static Value fn_movmin(const Value *args, Stream *stream){
+	const char *error;
+	Window *w = get_window(stream, WK_Min, args[1].real, &error);
+	if (w == NULL) return ERROR_VALUE(error, 0);
+	return REAL_VALUE(window_push_extreme(w, args[0].real));
+}
+
+static Value fn_movmax(const Value *args, Stream *stream){
+	const char *error;
+	Window *w = get_window(stream, WK_Max, args[1].real, &error);
+	if (w == NULL) return ERROR_VALUE(error, 0);
+	return REAL_VALUE(window_push_extreme(w, args[0].real));
+}
+
+static Value fn_ewma(const Value *args, Stream *stream){
+	const char *error;
+	double alpha = args[1].real;
+	if (!(0.0 < alpha && alpha <= 1.0)) return ERROR_VALUE("smoothing factor out of range", 0);
+	Window *w = get_window(stream, WK_Ewma, 1.0, &error);
+	if (w == NULL) return ERROR_VALUE(error, 0);
+	w->sum = w->count == 0 ? args[0].real : w->sum + alpha*(args[0].real - w->sum);
+	w->count += 1;
+	return REAL_VALUE(w->sum);
+}
+
+// integers go through doubles, so they are exact up to 2^53
+#define MAX_EXACT_INTEGER 9007199254740992.0
+
+static bool get_natural(Value value, uint64_t *res){
+	if (!(0.0 <= value.real && value.real <= MAX_EXACT_INTEGER) || value.real != floor(value.real)) return false;
+	*res = (uint64_t)value.real;
+	return true;
+}
+
+static Value fn_isprime(const Value *args, Stream *stream){
+	uint64_t n;
+	if (!get_natural(args[0], &n)) return ERROR_VALUE("expected an integer from 0 to 2^53", 0);
+	return REAL_VALUE((double)is_prime_u64(n));
+}
+
+static Value fn_nextprime(const Value *args, Stream *stream){
+	uint64_t n;
+	if (!get_natural(args[0], &n)) return ERROR_VALUE("expected an integer from 0 to 2^53", 0);
+	if (n < 2) return REAL_VALUE(2.0);
+	n += n % 2 == 0 ? 1 : 2;
+	while (!is_prime_u64(n)) n += 2;
+	if (n > MAX_EXACT_INTEGER) return ERROR_VALUE("result too large", 0);
+	return REAL_VALUE((double)n);
+}
+
+static Value fn_primepi(const Value *args, Stream *stream){
+	uint64_t n;
+	if (!get_natural(args[0], &n)) return ERROR_VALUE("expected an integer from 0 to 2^53", 0);
+	return REAL_VALUE((double)prime_count_u64(n));
+}
+
+// fixed(x) rounds x to Q32.32, real(x) turns it back into a real
+static Value fn_fixed(const Value *args, Stream *stream){
+	int64_t raw;
+	if (!to_fixed(args[0], &raw)) return ERROR_VALUE("expected a real", 0);
+	return make_fixed(raw);
+}
+
+static Value fn_decimal(const Value *args, Stream *stream){
+	Decimal d;
+	if (!to_decimal(args[0], &d)) return ERROR_VALUE("expected a finite real", 0);
+	return make_decimal(d);
+}
+
+static Value fn_real(const Value *args, Stream *stream){
+	return args[0];
+}
+
+// mod(a, m), a can be any integer, m from 2 to 2^53
+static Value fn_mod(const Value *args, Stream *stream){
+	uint64_t n;
+	if (!get_natural(args[1], &n) || n < 2) return ERROR_VALUE("modulus must be an integer from 2 to 2^53", 0);
+	if (args[0].type == DT_Big) return make_modular(big_mod_u64(get_big(args[0]), n), n);
+	if (args[0].type != DT_Real) return ERROR_VALUE("expected an integer", 0);
+	double a = args[0].real;
+	if (!(fabs(a) <= MAX_EXACT_INTEGER) || a != floor(a)) return ERROR_VALUE("expected an integer", 0);
+	uint64_t residue = (uint64_t)fabs(a) % n;
+	if (a < 0.0 && residue != 0) residue = n - residue;
+	return make_modular(residue, n);
+}
+
+#define EXACT_RATIO_MAX 1000000
+#define EXACT_SMALL_K 4096
+#define MODULAR_RATIO_MAX (1 << 27)
+#define FACTORIAL_TABLE_MAX (1 << 24)
+
+// nCr(n, k), exact
+static Value fn_nCr(const Value *args, Stream *stream){
+	uint64_t n, k;
+	if (!get_natural(args[0], &n) || !get_natural(args[1], &k))
+		return ERROR_VALUE("expected an integer from 0 to 2^53", 0);
+	if (k > n) return REAL_VALUE(0.0);
+	if (k > n-k) k = n-k;
+	if (n <= EXACT_RATIO_MAX) return make_big(factorial_ratio(n, (uint64_t[]){k, n-k}, 2));
+	if (k > EXACT_SMALL_K) return ERROR_VALUE("arguments too large for an exact result", 0);
+	Big res = {1, limbs_alloc(1)};
+	res.limbs[0] = 1;
+	for (uint64_t i=1; i<=k; i+=1){
+		big_mul_word(&res, n-k+i);
+		big_div_word(&res, i);
+	}
+	return make_big(res);
+}
+
+// nPr(n, k), exact
+static Value fn_nPr(const Value *args, Stream *stream){
+	uint64_t n, k;
+	if (!get_natural(args[0], &n) || !get_natural(args[1], &k))
+		return ERROR_VALUE("expected an integer from 0 to 2^53", 0);
+	if (k > n) return REAL_VALUE(0.0);
+	if (n <= EXACT_RATIO_MAX) return make_big(factorial_ratio(n, (uint64_t[]){n-k}, 1));
+	if (k > EXACT_RATIO_MAX) return ERROR_VALUE("arguments too large for an exact result", 0);
+	uint64_t *words = limbs_alloc(k);
+	for (uint64_t i=0; i!=k; i+=1) words[i] = n-i;
+	Value res = make_big(big_product(words, k));
+	free(words);
+	return res;
+}
+
+// multinomial([k1, k2, ...]) = (k1+k2+...)! / (k1! k2! ...), exact
+static Value fn_multinomial(const Value *args, Stream *stream){
+	uint64_t *ks = checked_malloc(args[0].length * sizeof(uint64_t));
+	uint64_t total = 0;
+	for (size_t i=0; i!=args[0].length; i+=1){
+		if (!get_natural(REAL_VALUE(args[0].reals[i]), ks + i) || ks[i] > EXACT_RATIO_MAX){
+			free(ks);
+			return ERROR_VALUE("expected integers from 0 to 10^6", 0);
+		}
+		total += ks[i];
+	}
+	if (total > EXACT_RATIO_MAX){
+		free(ks);
+		return ERROR_VALUE("arguments too large for an exact result", 0);
+	}
+	Value res = make_big(factorial_ratio(total, ks, args[0].length));
+	free(ks);
+	return res;
+}
+
+static bool get_combinatorics_args(const Value *args, uint64_t *n, uint64_t *k, Value *modulus){
+	uint64_t m;
+	if (!get_natural(args[0], n) || !get_natural(args[1], k) || !get_natural(args[2], &m) || m < 2) return false;
+	*modulus = make_modular(0, m);
+	return true;
+}
+
+// nCrmod(n, k, m), through the factorial table of a prime modulus when it fits
+static Value fn_nCrmod(const Value *args, Stream *stream){
+	uint64_t n, k;
+	Value res;
+	if (!get_combinatorics_args(args, &n, &k, &res)) return ERROR_VALUE("expected integers from 0 to 2^53", 0);
+	if (res.type == DT_Error) return res;
+	const Modulus *m = moduli + res.modulus;
+	if (k > n) return res;
+	uint64_t table_size = (n < m->n-1 ? n : m->n-1) + 1;
+	if (is_prime_u64(m->n)){
+		if (table_size <= FACTORIAL_TABLE_MAX){
+			factorial_table_reserve(factorial_tables + res.modulus, m, table_size);
+			res.residue = binomial_lucas(factorial_tables + res.modulus, m, n, k);
+		} else{
+			if (!binomial_prime(m, n, k, &res.residue)) return ERROR_VALUE("arguments too large", 0);
+		}
+		return res;
+	}
+	if (n > MODULAR_RATIO_MAX) return ERROR_VALUE("arguments too large", 0);
+	res.residue = factorial_ratio_mod(m, n, (uint64_t[]){k, n-k}, 2);
+	return res;
+}
+
+// nPrmod(n, k, m)
+static Value fn_nPrmod(const Value *args, Stream *stream){
+	uint64_t n, k;
+	Value res;
+	if (!get_combinatorics_args(args, &n, &k, &res)) return ERROR_VALUE("expected integers from 0 to 2^53", 0);
+	if (res.type == DT_Error) return res;
+	const Modulus *m = moduli + res.modulus;
+	if (k > n) return res;
+	if (n < m->n && n < FACTORIAL_TABLE_MAX && is_prime_u64(m->n)){
+		FactorialTable *t = factorial_tables + res.modulus;
+		factorial_table_reserve(t, m, n+1);
+		res.residue = mod_mul(m, t->factorials[n], t->inverses[n-k]);
+		return res;
+	}
+	if (n <= MODULAR_RATIO_MAX){
+		res.residue = factorial_ratio_mod(m, n, (uint64_t[]){n-k}, 1);
+		return res;
+	}
+	if (k > MODULAR_RATIO_MAX) return ERROR_VALUE("arguments too large", 0);
+	res.residue = 1 % m->n;
+	for (uint64_t i=0; i!=k; i+=1) res.residue = mod_mul(m, res.residue, (n-i) % m->n);
+	return res;
+}
+
+static Value fn_factor(const Value *args, Stream *stream){
+	uint64_t n;
+	if (!get_natural(args[0], &n) || n == 0) return ERROR_VALUE("expected an integer from 1 to 2^53", 0);
+	uint64_t factors[64];
+	size_t count = factor_u64(n, factors);
+	Value res = make_vector(count);
+	for (size_t i=0; i!=count; i+=1) res.reals[i] = (double)factors[i];
+	return res;
+}
+
+// poly([c0, c1, ...]) = c0 + c1*x + ...
+static Value fn_poly(const Value *args, Stream *stream){
+	Value res = make_poly(poly_trim(args[0].reals, args[0].length));
+	memcpy(res.reals, args[0].reals, res.length * sizeof(double));
+	return res;
+}
+
+static Value fn_coeffs(const Value *args, Stream *stream){
+	Value res = make_vector(args[0].length);
+	memcpy(res.reals, args[0].reals, res.length * sizeof(double));
+	return res;
+}
+
+static Value fn_polyder(const Value *args, Stream *stream){
+	Value res = make_poly(args[0].length ? args[0].length-1 : 0);
+	for (size_t i=0; i!=res.length; i+=1) res.reals[i] = (double)(i+1) * args[0].reals[i+1];
+	return res;
+}
+
+static Value poly_division(const Value *args, bool remainder){
+	Value a = args[0], b = args[1];
+	if (b.length == 0) return ERROR_VALUE("division by zero", 0);
+	if (a.length < b.length){
+		if (remainder) return a;
+		return make_poly(0);
+	}
+	Value q = make_poly(a.length - b.length + 1);
+	Value r = make_poly(b.length - 1);
+	poly_divmod(a.reals, a.length, b.reals, b.length, q.reals, r.reals);
+	if (!remainder) return q;
+	r.length = poly_trim(r.reals, r.length);
+	return r;
+}
+
+static Value fn_polydiv(const Value *args, Stream *stream){
+	return poly_division(args, false);
+}
+
+static Value fn_polyrem(const Value *args, Stream *stream){
+	return poly_division(args, true);
+}
+
+static Value fn_polygcd(const Value *args, Stream *stream){
+	Value res = make_poly(args[0].length > args[1].length ? args[0].length : args[1].length);
+	res.length = poly_gcd(args[0].reals, args[0].length, args[1].reals, args[1].length, res.reals);
+	return res;
+}
+
+// polyeval(p, x) at a real or at every element of a vector
+static Value fn_polyeval(const Value *args, Stream *stream){
+	Value x = args[1];
+	demote_bigs(&x, 1);
+	if (x.type == DT_Real) return REAL_VALUE(poly_horner(args[0].reals, args[0].length, x.real));
+	if (x.type != DT_Vector) return ERROR_VALUE("wrong data type", 0);
+	Value res = make_vector(x.length);
+	poly_eval_points(args[0].reals, args[0].length, x.reals, x.length, res.reals);
+	return res;
+}
+
+// fft(v) of a real vector, complex results are interleaved [re0, im0, re1, ...]
+static Value fn_fft(const Value *args, Stream *stream){
+	size_t n = args[0].length;
+	double *re = checked_malloc((2*n + 1) * sizeof(double));
+	double *im = re + n;
+	memcpy(re, args[0].reals, n * sizeof(double));
+	memset(im, 0, n * sizeof(double));
+	fft(re, im, n, false);
+	Value res = make_vector(2*n);
+	for (size_t k=0; k!=n; k+=1){
+		res.reals[2*k] = re[k];
+		res.reals[2*k + 1] = im[k];
+	}
+	free(re);
+	return res;
+}
+
+// ifft(c) of an interleaved spectrum, the real part of the signal
+static Value fn_ifft(const Value *args, Stream *stream){
+	if (args[0].length % 2 != 0) return ERROR_VALUE("expected interleaved complex values", 0);
+	size_t n = args[0].length / 2;
+	double *re = checked_malloc((2*n + 1) * sizeof(double));
+	double *im = re + n;
+	for (size_t k=0; k!=n; k+=1){
+		re[k] = args[0].reals[2*k];
+		im[k] = args[0].reals[2*k + 1];
+	}
+	fft(re, im, n, true);
+	Value res = make_vector(n);
+	for (size_t k=0; k!=n; k+=1) res.reals[k] = re[k] / (double)n;
+	free(re);
+	return res;
+}
+
+// conv(a, b), the full linear convolution
+static Value fn_conv(const Value *args, Stream *stream){
+	if (args[0].length == 0 || args[1].length == 0) return make_vector(0);
+	Value res = make_vector(args[0].length + args[1].length - 1);
+	poly_mul(res.reals, args[0].reals, args[0].length, args[1].reals, args[1].length);
+	return res;
+}
+
+// xcorr(a, b) at every lag from -(length of b - 1) to length of a - 1
+static Value fn_xcorr(const Value *args, Stream *stream){
+	if (args[0].length == 0 || args[1].length == 0) return make_vector(0);
+	size_t b_size = args[1].length;
+	double *reversed = checked_malloc(b_size * sizeof(double));
+	for (size_t i=0; i!=b_size; i+=1) reversed[i] = args[1].reals[b_size-1 - i];
+	Value res = make_vector(args[0].length + b_size - 1);
+	poly_mul(res.reals, args[0].reals, args[0].length, reversed, b_size);
+	free(reversed);
+	return res;
+}
+
+// the table of interp(x, xs, ys) stays cached until xs or ys is freed, x can
+// be a real or a vector of points
+static Value interpolate(const Value *args, InterpKind kind){
+	if (args[1].type != DT_Vector || args[2].type != DT_Vector) return ERROR_VALUE("wrong data type", 0);
+	if (args[1].length != args[2].length) return ERROR_VALUE("vectors differ in length", 0);
+	const InterpTable *table;
+	const char *error = interp_table(&table, args[1].reals, args[2].reals, args[1].length, kind);
+	if (error != NULL) return ERROR_VALUE(error, 0);
+	Value x = args[0];
+	demote_bigs(&x, 1);
+	if (x.type == DT_Real) return REAL_VALUE(interp_at(table, x.real));
+	if (x.type != DT_Vector) return ERROR_VALUE("wrong data type", 0);
+	Value res = make_vector(x.length);
+	interp_points(table, x.reals, res.reals, x.length);
+	return res;
+}
+
+static Value fn_interp(const Value *args, Stream *stream){
+	return interpolate(args, IK_Linear);
+}
+
+static Value fn_spline(const Value *args, Stream *stream){
+	return interpolate(args, IK_Spline);
+}
+
+static Value fn_pchip(const Value *args, Stream *stream){
+	return interpolate(args, IK_Monotone);
+}
+
+#define PERCENTILE_SORT_MIN 16
+
+// interpolates between the two nearest order statistics, which are selected
+// from x unless the sorted keys are given
+static double percentile_of(const double *x, const uint64_t *sorted, size_t count, double p){
+	double h = (double)(count - 1) * p / 100.0;
+	size_t k = (size_t)h;
+	if (k >= count - 1) k = count - 1;
+	uint64_t pair[2];
+	if (sorted != NULL){
+		pair[0] = sorted[k];
+		pair[1] = sorted[k + (k+1 < count)];
+	} else{
+		select_pair(x, count, k, pair);
+	}
+	double low = sort_value(pair[0]);
+	if (h == (double)k) return low;
+	return low + (h - (double)k) * (sort_value(pair[1]) - low);
+}
+
+// percentile(v, p) for p from 0 to 100, or for every element of a vector of them
+static Value fn_percentile(const Value *args, Stream *stream){
+	size_t count = args[0].length;
+	if (count == 0) return ERROR_VALUE("empty vector", 0);
+	Value p = args[1];
+	demote_bigs(&p, 1);
+	double single = p.real;
+	if (p.type == DT_Real) p = (Value){.type = DT_Vector, .length = 1, .reals = &single};
+	if (p.type != DT_Vector) return ERROR_VALUE("wrong data type", 0);
+	for (size_t i=0; i!=p.length; i+=1){
+		if (!(p.reals[i] >= 0.0 && p.reals[i] <= 100.0)) return ERROR_VALUE("percentile out of range", 0);
+	}
+	uint64_t *sorted = NULL;
+	if (p.length >= PERCENTILE_SORT_MIN){
+		sorted = checked_malloc(count * sizeof(uint64_t));
+		sort_keys(sorted, args[0].reals, count);
+		radix_sort(sorted, NULL, count);
+	}
+	Value res = make_vector(p.length);
+	for (size_t i=0; i!=p.length; i+=1) res.reals[i] = percentile_of(args[0].reals, sorted, count, p.reals[i]);
+	free(sorted);
+	if (args[1].type != DT_Vector) return REAL_VALUE(res.reals[0]);
+	return res;
+}
+
+static Value fn_median(const Value *args, Stream *stream){
+	Value percentile[2] = {args[0], REAL_VALUE(50.0)};
+	return fn_percentile(percentile, stream);
+}
+
+// NaNs go last
+static Value fn_sort(const Value *args, Stream *stream){
+	size_t count = args[0].length;
+	Value res = make_vector(count);
+	uint64_t *keys = checked_malloc(count * sizeof(uint64_t));
+	sort_keys(keys, args[0].reals, count);
+	radix_sort(keys, NULL, count);
+	for (size_t i=0; i!=count; i+=1) res.reals[i] = sort_value(keys[i]);
+	free(keys);
+	return res;
+}
+
+// ranks from 1, equal elements share the mean of their ranks
+static Value fn_rank(const Value *args, Stream *stream){
+	size_t count = args[0].length;
+	Value res = make_vector(count);
+	uint64_t *keys = checked_malloc(count * sizeof(uint64_t));
+	uint32_t *indices = checked_malloc(count * sizeof(uint32_t));
+	sort_keys(keys, args[0].reals, count);
+	for (size_t i=0; i!=count; i+=1) indices[i] = i;
+	radix_sort(keys, indices, count);
+	for (size_t begin=0, end; begin!=count; begin=end){
+		for (end=begin+1; end!=count && keys[end]==keys[begin]; end+=1);
+		double rank = (double)(begin + 1 + end) / 2.0;
+		for (size_t i=begin; i!=end; i+=1) res.reals[indices[i]] = rank;
+	}
+	free(indices);
+	free(keys);
+	return res;
+}
+
+#define HIST_MAX_BINS (1 << 26)
+
+// hist(v, n, lo, hi) counts the elements in n equal bins from lo to hi, hi
+// itself falls in the last one and everything outside is left out
+static Value fn_hist(const Value *args, Stream *stream){
+	double n = args[1].real, lo = args[2].real, hi = args[3].real;
+	if (!(n >= 1.0 && n <= HIST_MAX_BINS && n == floor(n))) return ERROR_VALUE("bad number of bins", 0);
+	if (!(lo < hi) || !isfinite(hi - lo)) return ERROR_VALUE("empty range", 0);
+	Histogram h = {.x = args[0].reals, .count = args[0].length};
+	histogram_range(&h, (size_t)n, lo, hi);
+	Value res = make_vector(h.bin_count);
+	histogram(&h, res.reals);
+	return res;
+}
+
+// bincount(v) counts how many times each natural number up to the largest
+// element occurs
+static Value fn_bincount(const Value *args, Stream *stream){
+	if (args[0].length == 0) return make_vector(0);
+	double max = hist_natural_max(args[0].reals, args[0].length);
+	if (max < 0.0) return ERROR_VALUE("expected natural numbers", 0);
+	if (max >= HIST_MAX_BINS) return ERROR_VALUE("too many bins", 0);
+	Histogram h = {.x = args[0].reals, .count = args[0].length};
+	histogram_range(&h, (size_t)max + 1, 0.0, max + 1.0);
+	Value res = make_vector(h.bin_count);
+	histogram(&h, res.reals);
+	return res;
+}
+
+static const Function functions[BA_Count] = {
+#define BUILTIN_KEYWORD(name)
+#define BUILTIN_CONSTANT(name, value)
+#define BUILTIN_FUNCTION(name, args, call, kernel_op) [BA_##name] = {sizeof(args)-1, args, call, kernel_op},
+#define BUILTIN_FORM(name, form, call) [BA_##name] = {0, NULL, call, KO_None, form},
+#include "builtins.def"
+#undef BUILTIN_KEYWORD
+#undef BUILTIN_CONSTANT
+#undef BUILTIN_FUNCTION
+#undef BUILTIN_FORM
+};
+
+static const Function *get_function(uint32_t atom){
+	if (atom >= BA_Count || builtin_kinds[atom] != BK_Function) return NULL;
+	return functions + atom;
+}
+
+#define FUNCTION_ARG_CAPACITY 8
+
+// big and fixed point values are demoted where a real is expected and passed
+// on as they are to functions that take any value, reals are promoted where a polynomial is
+// expected. Decimals are reals to every function.
+static Value call_function(const Function *func, const Value *args, size_t arg_count, Stream *stream){
+	if (arg_count != func->arg_count) return ERROR_VALUE("wrong number of arguments", 0);
+	Value checked[FUNCTION_ARG_CAPACITY];
+	for (size_t i=0; i!=arg_count; i+=1){
+		checked[i] = args[i];
+		demote_decimals(checked + i, 1);
+		switch (func->arg_types[i]){
+		case 'r':
+			demote_bigs(checked + i, 1);
+			if (checked[i].type == DT_Fixed) checked[i] = REAL_VALUE(fixed_to_double(checked[i].integer));
+			if (checked[i].type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+			break;
+		case 'v':
+			if (checked[i].type != DT_Vector) return ERROR_VALUE("wrong data type", 0);
+			break;
+		case 'p':
+			demote_bigs(checked + i, 1);
+			if (!to_poly(checked + i)) return ERROR_VALUE("wrong data type", 0);
+			break;
+		default:
+			if (checked[i].type < DT_Real) return ERROR_VALUE("wrong data type", 0);
+		}
+	}
+	return func->call(checked, stream);
+}
+
+
+static const char *add_operator(
+	const char *text, size_t size, Fixity fixity, const Function *func, NodeType type, Precedence prec
+){
+	Spelling *sp = NULL;
+	for (size_t i=0; i!=operators.spelling_count; i+=1){
+		if (operators.spellings[i].size == size && memcmp(operators.spellings[i].text, text, size) == 0){
+			sp = operators.spellings + i;
+			break;
+		}
+	}
+	if (sp == NULL){
+		if (operators.spelling_count == OPERATOR_CAPACITY) return "too many operators";
+		sp = operators.spellings + operators.spelling_count;
+		operators.spelling_count += 1;
+		memcpy(sp->text, text, size);
+		sp->size = size;
+		uint8_t *link = operators.first + (uint8_t)text[0];
+		while (*link != 0 && operators.spellings[*link-1].size > size) link = &operators.spellings[*link-1].next;
+		sp->next = *link;
+		*link = sp - operators.spellings + 1;
+	}
+
+	// an operator after a value has to be unambiguously infix or postfix
+	Fixity other = fixity == FX_Infix ? FX_Postfix : fixity == FX_Postfix ? FX_Infix : FX_Prefix;
+	if (other != fixity && sp->types[other] != NT_Global) return "operator already declared";
+	if (sp->types[fixity] != NT_Global && sp->types[fixity] < NT_User) return "operator already declared";
+
+	if (func != NULL){
+		if (sp->types[fixity] != NT_Global){
+			type = sp->types[fixity];
+		} else{
+			if (operators.user_count == USER_OPERATOR_CAPACITY) return "too many operators";
+			type = NT_User + operators.user_count;
+			operators.user_count += 1;
+		}
+		operators.users[type - NT_User] = (UserOperator){func, fixity == FX_Infix ? 2 : 1};
+	}
+	sp->types[fixity] = type;
+	operators.precs[type] = prec;
+	return NULL;
+}
+
+static Precedence make_prec(Fixity fixity, uint8_t prec, bool right_assoc){
+	if (fixity == FX_Infix && right_assoc) return (Precedence){prec+1, prec};
+	return (Precedence){prec, prec};
+}
+
+static void init_operators(void){
+	for (size_t i=0; i!=NODE_TYPE_CAPACITY; i+=1) operators.precs[i] = (Precedence){255, 255};
+	operators.precs[NT_Global]   = (Precedence){0, 0};
+	operators.precs[NT_Newline]  = (Precedence){1, 0};
+	operators.precs[NT_ClosePar] = (Precedence){1, 0};
+	operators.precs[NT_CloseBracket] = (Precedence){1, 0};
+	operators.precs[NT_Comma]    = (Precedence){1, 0};
+	operators.precs[NT_OpenPar]  = (Precedence){99, 0};
+	operators.precs[NT_Call]     = (Precedence){99, 0};
+	operators.precs[NT_List]     = (Precedence){99, 0};
+	operators.precs[NT_Question] = (Precedence){10, 2};
+	operators.precs[NT_Colon]    = (Precedence){3, 3};
+
+	add_operator("+",  1, FX_Prefix,  NULL, NT_Plus,         (Precedence){59, 59});
+	add_operator("-",  1, FX_Prefix,  NULL, NT_Minus,        (Precedence){59, 59});
+	add_operator("+",  1, FX_Infix,   NULL, NT_Add,          (Precedence){50, 50});
+	add_operator("-",  1, FX_Infix,   NULL, NT_Subtract,     (Precedence){50, 50});
+	add_operator("*",  1, FX_Infix,   NULL, NT_Multiply,     (Precedence){55, 55});
+	add_operator("/",  1, FX_Infix,   NULL, NT_Divide,       (Precedence){55, 55});
+	add_operator("^",  1, FX_Infix,   NULL, NT_Power,        (Precedence){61, 60});
+	add_operator("!",  1, FX_Postfix, NULL, NT_Factorial,    (Precedence){62, 62});
+	add_operator("<",  1, FX_Infix,   NULL, NT_Less,         (Precedence){35, 35});
+	add_operator("<=", 2, FX_Infix,   NULL, NT_LessEqual,    (Precedence){35, 35});
+	add_operator(">",  1, FX_Infix,   NULL, NT_Greater,      (Precedence){35, 35});
+	add_operator(">=", 2, FX_Infix,   NULL, NT_GreaterEqual, (Precedence){35, 35});
+	add_operator("==", 2, FX_Infix,   NULL, NT_Equal,        (Precedence){30, 30});
+	add_operator("!=", 2, FX_Infix,   NULL, NT_NotEqual,     (Precedence){30, 30});
+	add_operator("&&", 2, FX_Infix,   NULL, NT_And,          (Precedence){25, 25});
+	add_operator("||", 2, FX_Infix,   NULL, NT_Or,           (Precedence){20, 20});
+
+	add_operator("**", 2, FX_Infix,   get_function(BA_pow),     0, (Precedence){61, 60});
+	add_operator("%",  1, FX_Postfix, get_function(BA_percent), 0, (Precedence){62, 62});
+}
+
+static bool is_keyword(Node token, uint32_t keyword){
+	return token.type == NT_Identifier && token.atom == keyword;
+}
+
+#define MIN_USER_PREC 11
+#define MAX_USER_PREC 97
+
+// infix <spelling> <precedence> left|right <function>
+// prefix|postfix <spelling> <precedence> <function>
+static Value declare_operator(const char *line, Fixity fixity){
+	const char *it = line;
+	get_token(line, &it);
+
+	while (*it==' ' || *it=='\t') it += 1;
+	const char *text = it;
+	while (is_operator_char(*it)) it += 1;
+	size_t size = it - text;
+	if (size == 0 || size > 3) return ERROR_VALUE("invalid operator spelling", text - line);
+
+	Node prec = get_token(line, &it);
+	if (prec.type == NT_Decimal){
+		prec.type = NT_Number;
+		prec.real = decimal_to_double((Decimal){.coefficient = prec.integer, .exponent = prec.exponent});
+	}
+	if (
+		prec.type != NT_Number || prec.real != floor(prec.real) ||
+		prec.real < MIN_USER_PREC || prec.real > MAX_USER_PREC
+	) return ERROR_VALUE("precedence must be an integer from 11 to 97", prec.pos);
+
+	bool right_assoc = false;
+	if (fixity == FX_Infix){
+		Node assoc = get_token(line, &it);
+		if (is_keyword(assoc, BA_right))
+			right_assoc = true;
+		else if (!is_keyword(assoc, BA_left))
+			return ERROR_VALUE("expected 'left' or 'right'", assoc.pos);
+	}
+
+	Node name = get_token(line, &it);
+	if (name.type != NT_Identifier) return ERROR_VALUE("expected function name", name.pos);
+	const Function *func = get_function(name.atom);
+	if (func == NULL) return ERROR_VALUE("function not found", name.pos);
+	if (func->arg_count != (fixity == FX_Infix ? 2 : 1))
+		return ERROR_VALUE("wrong number of arguments", name.pos);
+
+	Node end = get_token(line, &it);
+	if (end.type != NT_Newline) return ERROR_VALUE("expected end of line", end.pos);
+
+	const char *error = add_operator(text, size, fixity, func, 0, make_prec(fixity, prec.real, right_assoc));
+	if (error != NULL) return ERROR_VALUE(error, text - line);
+	return (Value){.type = DT_Void};
+}
+
+static Value apply_user_operator(NodeType type, Value *stack, size_t *stack_size, Stream *stream){
+	const UserOperator *op = operators.users + (type - NT_User);
+	Value res = call_function(op->function, stack + *stack_size - op->arity, op->arity, stream);
+	if (res.type == DT_Error) return res;
+	*stack_size -= op->arity;
+	stack[*stack_size] = res;
+	*stack_size += 1;
+	return res;
+}
+
+// a user operator bound to pow is the same operator as ^, so ** keeps units
+// and the number types that ^ keeps
+static NodeType builtin_operator(NodeType type){
+	if (type < NT_User) return type;
+	const UserOperator *op = operators.users + (type - NT_User);
+	return op->function == get_function(BA_pow) && op->arity == 2 ? NT_Power : type;
+}
+
+static size_t operand_count(NodeType type){
+	switch (type){
+	case NT_Plus:
+	case NT_Minus:
+	case NT_Factorial:
+		return 1;
+	case NT_Colon:
+		return 3;
+	default:
+		return type >= NT_User ? operators.users[type - NT_User].arity : 2;
+	}
+}
+
+static const KernelOpcode operator_kernel_ops[NT_User] = {
+	[NT_Minus]        = KO_Negate,
+	[NT_Add]          = KO_Add,
+	[NT_Subtract]     = KO_Subtract,
+	[NT_Multiply]     = KO_Multiply,
+	[NT_Divide]       = KO_Divide,
+	[NT_Power]        = KO_Power,
+	[NT_Factorial]    = KO_Factorial,
+	[NT_Less]         = KO_Less,
+	[NT_LessEqual]    = KO_LessEqual,
+	[NT_Greater]      = KO_Greater,
+	[NT_GreaterEqual] = KO_GreaterEqual,
+	[NT_Equal]        = KO_Equal,
+	[NT_NotEqual]     = KO_NotEqual,
+	[NT_And]          = KO_And,
+	[NT_Or]           = KO_Or,
+	[NT_Colon]        = KO_Select,
+};
+
+static bool has_lanes(const Value *args, size_t arg_count){
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (args[i].type == DT_Lanes) return true;
+	}
+	return false;
+}
+
+// Units of the result of an operator, found before it is traced or applied.
+// Returns an error message or NULL.
+static const char *operator_units(NodeType type, const Value *args, Units *res){
+	size_t arg_count = operand_count(type);
+	*res = 0;
+	bool has_units = false;
+	for (size_t i=0; i!=arg_count; i+=1) has_units |= value_units(args[i]) != 0;
+	if (!has_units) return NULL;
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (
+			args[i].type != DT_Real && args[i].type != DT_Lanes &&
+			args[i].type != DT_Big && args[i].type != DT_Decimal
+		) return "wrong data type";
+	}
+	switch (type){
+	case NT_Plus:
+	case NT_Minus:
+		*res = value_units(args[0]);
+		return NULL;
+	case NT_Add:
+	case NT_Subtract:
+		*res = value_units(args[0]);
+		return value_units(args[0]) == value_units(args[1]) ? NULL : "units do not match";
+	case NT_Less:
+	case NT_LessEqual:
+	case NT_Greater:
+	case NT_GreaterEqual:
+	case NT_Equal:
+	case NT_NotEqual:
+		return value_units(args[0]) == value_units(args[1]) ? NULL : "units do not match";
+	case NT_Multiply:
+	case NT_Divide:
+		if (!units_multiply(value_units(args[0]), value_units(args[1]), type == NT_Multiply ? 1 : -1, res))
+			return "unit power too large";
+		return NULL;
+	case NT_Power:
+		if (value_units(args[1]) != 0) return "exponent must not have units";
+		if (args[1].type != DT_Real && args[1].type != DT_Decimal) return "power of units must be a constant";
+		double e = args[1].type == DT_Decimal ? decimal_to_double(get_decimal(args[1])) : args[1].real;
+		return units_power(value_units(args[0]), e, res);
+	case NT_Colon:
+		if (value_units(args[0]) != 0) return "expected a value without units";
+		*res = value_units(args[1]);
+		return value_units(args[1]) == value_units(args[2]) ? NULL : "units do not match";
+	default:
+		return "expected a value without units";
+	}
+}
+
+// While a kernel is compiled, operators with an operand that depends on its
+// variables are emitted into it instead of being applied, and everything else
+// is folded by the evaluator as usual. DT_Void means the operator was not traced.
+static Value trace_operator(Kernel *kernel, NodeType type, Value *stack, size_t *stack_size){
+	if (kernel == NULL || type == NT_Question) return (Value){.type = DT_Void};
+	size_t arg_count = operand_count(type);
+	Value *args = stack + *stack_size - arg_count;
+	if (!has_lanes(args, arg_count)) return (Value){.type = DT_Void};
+
+	Value res = args[0];
+	if (type != NT_Plus){
+		KernelOpcode code = type >= NT_User
+			? operators.users[type - NT_User].function->kernel_op
+			: operator_kernel_ops[type];
+		if (code == KO_None) return ERROR_VALUE("function cannot be compiled", 0);
+		res = kernel_emit(kernel, code, args, arg_count);
+		if (res.type == DT_Error) return res;
+	}
+	*stack_size -= arg_count;
+	stack[*stack_size] = res;
+	*stack_size += 1;
+	return res;
+}
+
+// random functions are always traced, they have to give every lane its own number
+static Value trace_call(Kernel *kernel, const Function *func, const Value *args, size_t arg_count){
+	if (kernel == NULL || !(has_lanes(args, arg_count) || is_random_op(func->kernel_op)))
+		return (Value){.type = DT_Void};
+	if (arg_count != func->arg_count) return ERROR_VALUE("wrong number of arguments", 0);
+	if (func->kernel_op == KO_None) return ERROR_VALUE("function cannot be compiled", 0);
+	return kernel_emit(kernel, func->kernel_op, args, arg_count);
+}
+
+static Value kernel_variable(const Kernel *kernel, uint32_t atom){
+	for (size_t i=0; kernel!=NULL && i!=kernel->var_count; i+=1){
+		if (kernel->vars[i] == atom) return (Value){.type = DT_Lanes, .reg = i};
+	}
+	return (Value){.type = DT_Void};
+}
+
+// integer operands join the modulus of the other operand
+static bool to_residue(Value value, const Modulus *m, uint64_t *res){
+	if (value.type == DT_Modular){
+		*res = value.residue;
+		return true;
+	}
+	if (value.type == DT_Big){
+		*res = big_mod_u64(get_big(value), m->n);
+		return true;
+	}
+	double a = value.real;
+	if (value.type != DT_Real || !(fabs(a) <= MAX_EXACT_INTEGER) || a != floor(a)) return false;
+	*res = (uint64_t)fabs(a) % m->n;
+	if (a < 0.0 && *res != 0) *res = m->n - *res;
+	return true;
+}
+
+// Operators with a modular operand compute in the ring of its modulus, the
+// exponent of a power stays an integer. DT_Void means no operand is modular.
+static Value apply_modular(NodeType type, Value *stack, size_t *stack_size){
+	if (type == NT_Question || type >= NT_User) return (Value){.type = DT_Void};
+	size_t arg_count = operand_count(type);
+	Value *args = stack + *stack_size - arg_count;
+	size_t index = 0;
+	while (index != arg_count && args[index].type != DT_Modular) index += 1;
+	if (index == arg_count) return (Value){.type = DT_Void};
+	uint32_t modulus = args[index].modulus;
+	const Modulus *m = moduli + modulus;
+
+	Value res = {.type = DT_Modular, .modulus = modulus};
+	uint64_t a, b;
+	if (type == NT_Power){
+		double e = args[1].real;
+		if (args[0].type != DT_Modular || args[1].type != DT_Real || !(fabs(e) < 0x1p64) || e != floor(e))
+			return ERROR_VALUE("exponent must be an integer", 0);
+		a = args[0].residue;
+		if (e < 0.0 && !mod_inverse(m, a, &a)) return ERROR_VALUE("value has no inverse", 0);
+		res.residue = mod_pow(m, a, (uint64_t)fabs(e));
+		goto Push;
+	}
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (args[i].type == DT_Modular && args[i].modulus != modulus)
+			return ERROR_VALUE("different moduli", 0);
+	}
+	if (!to_residue(args[0], m, &a)) return ERROR_VALUE("wrong data type", 0);
+	if (arg_count == 2 && !to_residue(args[1], m, &b)) return ERROR_VALUE("wrong data type", 0);
+
+	switch (type){
+	case NT_Plus:      res.residue = a; break;
+	case NT_Minus:     res.residue = mod_sub(m, 0, a); break;
+	case NT_Add:       res.residue = mod_add(m, a, b); break;
+	case NT_Subtract:  res.residue = mod_sub(m, a, b); break;
+	case NT_Multiply:  res.residue = mod_mul(m, a, b); break;
+	case NT_Divide:
+		if (!mod_inverse(m, b, &b)) return ERROR_VALUE("divisor has no inverse", 0);
+		res.residue = mod_mul(m, a, b);
+		break;
+	case NT_Factorial: res.residue = mod_factorial(m, a); break;
+	case NT_Equal:     res = REAL_VALUE((double)(a == b)); break;
+	case NT_NotEqual:  res = REAL_VALUE((double)(a != b)); break;
+	default:           return ERROR_VALUE("wrong data type", 0);
+	}
+Push:
+	*stack_size -= arg_count;
+	stack[*stack_size] = res;
+	*stack_size += 1;
+	return res;
+}
+
+// Operators with a decimal operand compute in decimal when the others are
+// reals without units or big values, the exponent of a power has to be an
+// integer and comparisons give reals. Anything else, and every operand a
+// decimal cannot hold, turns the decimals into reals. DT_Void means the
+// operator was not applied.
+static Value apply_decimal(NodeType type, Value *stack, size_t *stack_size){
+	if (type == NT_Question) return (Value){.type = DT_Void};
+	size_t arg_count = operand_count(type);
+	Value *args = stack + *stack_size - arg_count;
+	bool has_decimal = false;
+	for (size_t i=0; i!=arg_count; i+=1) has_decimal |= args[i].type == DT_Decimal;
+	if (!has_decimal) return (Value){.type = DT_Void};
+
+	Decimal a, b = {0}, c;
+	bool exact = type < NT_User && type != NT_Factorial && type != NT_And && type != NT_Or;
+	decimal_inexact = false;
+	for (size_t i=0; i!=arg_count; i+=1){
+		exact &= args[i].type == DT_Decimal || args[i].type == DT_Big || (args[i].type == DT_Real && args[i].units == 0);
+	}
+	if (exact && type == NT_Power){
+		double e = args[1].type == DT_Decimal ? decimal_to_double(get_decimal(args[1])) : args[1].real;
+		exact &= args[1].type != DT_Big && fabs(e) < 0x1p63 && e == floor(e);
+		exact &= to_decimal(args[0], &a);
+		b = (Decimal){.coefficient = (int64_t)e};
+	} else if (exact && type != NT_Colon){
+		exact &= to_decimal(args[0], &a);
+		if (arg_count == 2) exact &= to_decimal(args[1], &b);
+	}
+	if (!exact){
+		demote_decimals(args, arg_count);
+		return (Value){.type = DT_Void};
+	}
+
+	Value res;
+	const char *error = NULL;
+	switch (type){
+	case NT_Plus:         c = a; break;
+	case NT_Minus:        c = (Decimal){.coefficient = -a.coefficient, .exponent = a.exponent, .negative = !a.negative}; break;
+	case NT_Add:          error = decimal_add(a, b, decimal_rounding, &c); break;
+	case NT_Subtract:     error = decimal_sub(a, b, decimal_rounding, &c); break;
+	case NT_Multiply:     error = decimal_mul(a, b, decimal_rounding, &c); break;
+	case NT_Divide:       error = decimal_div(a, b, decimal_rounding, &c); break;
+	case NT_Power:        error = decimal_pow(a, b.coefficient, decimal_rounding, &c); break;
+	case NT_Less:         res = REAL_VALUE((double)(decimal_compare(a, b) < 0)); goto Push;
+	case NT_LessEqual:    res = REAL_VALUE((double)(decimal_compare(a, b) <= 0)); goto Push;
+	case NT_Greater:      res = REAL_VALUE((double)(decimal_compare(a, b) > 0)); goto Push;
+	case NT_GreaterEqual: res = REAL_VALUE((double)(decimal_compare(a, b) >= 0)); goto Push;
+	case NT_Equal:        res = REAL_VALUE((double)(decimal_compare(a, b) == 0)); goto Push;
+	case NT_NotEqual:     res = REAL_VALUE((double)(decimal_compare(a, b) != 0)); goto Push;
+	case NT_Colon:{
+		Value cond = args[0];
+		demote_decimals(&cond, 1);
+		demote_bigs(&cond, 1);
+		if (cond.type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+		res = cond.real != 0.0 ? args[1] : args[2];
+		goto Push;
+	}
+	default:              return ERROR_VALUE("wrong data type", 0);
+	}
+	if (error != NULL) return ERROR_VALUE(error, 0);
+	// a sum, difference, product or power of integers that had to be rounded
+	// is left to reals, which is what it gives without --decimal
+	bool integral = (type == NT_Add || type == NT_Subtract || type == NT_Multiply || type == NT_Power)
+		&& a.exponent >= 0 && (type == NT_Power || b.exponent >= 0);
+	if (integral && decimal_inexact && c.exponent >= 0){
+		demote_decimals(args, arg_count);
+		return (Value){.type = DT_Void};
+	}
+	res = make_decimal(c);
+Push:
+	*stack_size -= arg_count;
+	stack[*stack_size] = res;
+	*stack_size += 1;
 	return res;
 }
 
+// Operators with a fixed point operand compute in fixed point, the exponent of
+// a power has to be an integer and comparisons give reals. DT_Void means no
+// operand is fixed point.
+static Value apply_fixed(NodeType type, Value *stack, size_t *stack_size){
+	bool percent = type >= NT_User && operators.users[type - NT_User].function == get_function(BA_percent);
+	if (type == NT_Question || (type >= NT_User && !percent)) return (Value){.type = DT_Void};
+	size_t arg_count = operand_count(type);
+	Value *args = stack + *stack_size - arg_count;
+	bool has_fixed = false;
+	for (size_t i=0; i!=arg_count; i+=1) has_fixed |= args[i].type == DT_Fixed;
+	if (!has_fixed) return (Value){.type = DT_Void};
 
-typedef uint16_t DataType;
-enum DataType{
-	DT_Void = 0,
-	DT_Error,
-	DT_Real
-};
-
-typedef struct Value{
-	DataType type;
-	uint16_t size;
-	union{
-		double real;
-		int64_t integer;
-		const char *string;
-		const char *error;
-	};
-} Value;
+	Value res;
+	int64_t a, b;
+	if (type == NT_Power){
+		demote_bigs(args + 1, 1);
+		double e = args[1].real;
+		if (args[0].type != DT_Fixed || args[1].type != DT_Real || !(fabs(e) < 0x1p63) || e != floor(e))
+			return ERROR_VALUE("exponent must be an integer", 0);
+		if (!fixed_pow(args[0].integer, (int64_t)e, fixed_overflow, &a)) return ERROR_VALUE("divide by zero", 0);
+		res = make_fixed(a);
+		goto Push;
+	}
+	if (type == NT_Colon){
+		if (!to_fixed(args[0], &a) || !to_fixed(args[1], &b) || !to_fixed(args[2], &b))
+			return ERROR_VALUE("wrong data type", 0);
+		res = a != 0 ? args[1] : args[2];
+		goto Push;
+	}
+	if (!to_fixed(args[0], &a)) return ERROR_VALUE("wrong data type", 0);
+	if (arg_count == 2 && !to_fixed(args[1], &b)) return ERROR_VALUE("wrong data type", 0);
+	if (percent){
+		res = make_fixed(fixed_div(a, 100*FIXED_ONE, fixed_overflow));
+		goto Push;
+	}
 
+	switch (type){
+	case NT_Plus:         res = make_fixed(a); break;
+	case NT_Minus:        res = make_fixed(fixed_sub(0, a, fixed_overflow)); break;
+	case NT_Add:          res = make_fixed(fixed_add(a, b, fixed_overflow)); break;
+	case NT_Subtract:     res = make_fixed(fixed_sub(a, b, fixed_overflow)); break;
+	case NT_Multiply:     res = make_fixed(fixed_mul(a, b, fixed_overflow)); break;
+	case NT_Divide:
+		if (b == 0) return ERROR_VALUE("divide by zero", 0);
+		res = make_fixed(fixed_div(a, b, fixed_overflow));
+		break;
+	case NT_Less:         res = REAL_VALUE((double)(a < b)); break;
+	case NT_LessEqual:    res = REAL_VALUE((double)(a <= b)); break;
+	case NT_Greater:      res = REAL_VALUE((double)(a > b)); break;
+	case NT_GreaterEqual: res = REAL_VALUE((double)(a >= b)); break;
+	case NT_Equal:        res = REAL_VALUE((double)(a == b)); break;
+	case NT_NotEqual:     res = REAL_VALUE((double)(a != b)); break;
+	case NT_And:          res = REAL_VALUE((double)((a != 0) & (b != 0))); break;
+	case NT_Or:           res = REAL_VALUE((double)((a != 0) | (b != 0))); break;
+	default:              return ERROR_VALUE("wrong data type", 0);
+	}
+Push:
+	*stack_size -= arg_count;
+	stack[*stack_size] = res;
+	*stack_size += 1;
+	return res;
+}
 
-#define SYMBOL_CAPACITY 64
-typedef struct SymbolTable{
-	size_t symbol_count;
-	const char *names[SYMBOL_CAPACITY];
-	uint8_t name_sizes[SYMBOL_CAPACITY];
-	Value values[SYMBOL_CAPACITY];
-} SymbolTable;
+// Operators with a polynomial operand work on polynomials, reals turn into
+// constant ones. A polynomial can be divided by a real and raised to a natural
+// power, polydiv and polyrem divide by other polynomials.
+static Value apply_polynomial(NodeType type, Value *stack, size_t *stack_size){
+	if (type == NT_Question || type >= NT_User) return (Value){.type = DT_Void};
+	size_t arg_count = operand_count(type);
+	Value *args = stack + *stack_size - arg_count;
+	if (args[0].type != DT_Poly && (arg_count == 1 || args[1].type != DT_Poly)) return (Value){.type = DT_Void};
+	demote_bigs(args, arg_count);
 
-static Value get_identifier(const SymbolTable *symbols, const char *name, size_t name_size){
-	for (size_t i=0; i!=symbols->symbol_count; i+=1){
-		if (
-			symbols->name_sizes[i] == name_size &&
-			memcmp(symbols->names[i], name, name_size) == 0
-		) return symbols->values[i];
+	Value res;
+	if (type == NT_Power){
+		double e = args[1].real;
+		if (args[0].type != DT_Poly || args[1].type != DT_Real || !(e >= 0.0 && e < 0x1p32) || e != floor(e))
+			return ERROR_VALUE("exponent must be a natural number", 0);
+		Value base = args[0];
+		res = make_poly(1);
+		res.reals[0] = 1.0;
+		for (uint64_t bits=(uint64_t)e; bits!=0; bits>>=1){
+			if ((bits & 1) && base.length != 0){
+				Value t = make_poly(res.length + base.length - 1);
+				poly_mul(t.reals, res.reals, res.length, base.reals, base.length);
+				res = t;
+			}
+			if (bits > 1 && base.length != 0){
+				Value t = make_poly(2*base.length - 1);
+				poly_mul(t.reals, base.reals, base.length, base.reals, base.length);
+				base = t;
+			}
+		}
+		if (base.length == 0 && e != 0.0) res.length = 0;
+		goto Push;
 	}
-	return (Value){.type = DT_Error, .error = "identifier not found"};
-}
+	if (type == NT_Divide){
+		if (args[0].type != DT_Poly || args[1].type != DT_Real) return ERROR_VALUE("wrong data type", 0);
+		if (args[1].real == 0.0) return ERROR_VALUE("division by zero", 0);
+		res = make_poly(args[0].length);
+		for (size_t i=0; i!=res.length; i+=1) res.reals[i] = args[0].reals[i] / args[1].real;
+		goto Push;
+	}
+	Value a = args[0], b = args[arg_count-1];
+	if (!to_poly(&a) || !to_poly(&b)) return ERROR_VALUE("wrong data type", 0);
 
-static void set_identifier(SymbolTable *symbols, const char *name, size_t name_size, Value value){
-	for (size_t i=0; i!=symbols->symbol_count; i+=1){
-		if (
-			symbols->name_sizes[i] == name_size &&
-			memcmp(symbols->names[i], name, name_size) == 0
-		){
-			symbols->values[i] = value;
-			return;
+	switch (type){
+	case NT_Plus:
+		res = a;
+		break;
+	case NT_Minus:
+		res = make_poly(a.length);
+		for (size_t i=0; i!=a.length; i+=1) res.reals[i] = -a.reals[i];
+		break;
+	case NT_Add:
+	case NT_Subtract:{
+		double sign = type == NT_Add ? 1.0 : -1.0;
+		res = make_poly(a.length > b.length ? a.length : b.length);
+		for (size_t i=0; i!=res.length; i+=1){
+			res.reals[i] = (i < a.length ? a.reals[i] : 0.0) + sign * (i < b.length ? b.reals[i] : 0.0);
+		}
+		res.length = poly_trim(res.reals, res.length);
+		break;
+	}
+	case NT_Multiply:
+		if (a.length == 0 || b.length == 0){
+			res = make_poly(0);
+			break;
 		}
+		res = make_poly(a.length + b.length - 1);
+		poly_mul(res.reals, a.reals, a.length, b.reals, b.length);
+		break;
+	case NT_Equal:
+	case NT_NotEqual:{
+		bool equal = a.length == b.length && memcmp(a.reals, b.reals, a.length * sizeof(double)) == 0;
+		res = REAL_VALUE((double)(equal == (type == NT_Equal)));
+		break;
 	}
-	size_t count = symbols->symbol_count;
-	symbols->names[count] = name;
-	symbols->name_sizes[count] = name_size;
-	symbols->values[count] = value;
-	symbols->symbol_count += 1;
+	default:
+		return ERROR_VALUE("wrong data type", 0);
+	}
+Push:
+	*stack_size -= arg_count;
+	stack[*stack_size] = res;
+	*stack_size += 1;
+	return res;
 }
 
-typedef struct Precedence{
-	uint8_t left;
-	uint8_t right;
-} Precedence;
-
-static Precedence get_prec(NodeType oper_type){
-	switch (oper_type){
-	case NT_Newline:   return (Precedence){1, 0};
-	case NT_Global:    return (Precedence){0, 0};
-	case NT_ClosePar:  return (Precedence){1, 0};
-	case NT_OpenPar:   return (Precedence){99, 0};
-	case NT_Minus:     return (Precedence){59, 59};
-	case NT_Add:       return (Precedence){50, 50};
-	case NT_Subtract:  return (Precedence){50, 50};
-	case NT_Multiply:  return (Precedence){55, 55};
-	case NT_Divide:    return (Precedence){55, 55};
-	case NT_Power:     return (Precedence){61, 60};
-	case NT_Factorial: return (Precedence){62, 62};
-	default:           return (Precedence){255, 255};
-	}
+// Operators with an operand of one of the number types above, or one that a
+// kernel being compiled depends on, in the order the types take precedence.
+// DT_Void means the operator is left to the real arithmetic of the evaluator.
+static Value apply_typed_operator(Kernel *kernel, NodeType type, Value *stack, size_t *stack_size){
+	Value res = apply_decimal(type, stack, stack_size);
+	if (res.type == DT_Void) res = trace_operator(kernel, type, stack, stack_size);
+	if (res.type == DT_Void) res = apply_modular(type, stack, stack_size);
+	if (res.type == DT_Void) res = apply_fixed(type, stack, stack_size);
+	if (res.type == DT_Void) res = apply_polynomial(type, stack, stack_size);
+	return res;
 }
 
+static Value call_form(const SymbolTable *symbols, const Function *func, const Node **iter, Stream *stream);
 
-static Value evaluate_line(const SymbolTable *symbols, const char *line){
-	const char *it = line;
-	Node opers[64];
+static Value evaluate_tokens(const SymbolTable *symbols, const Node *token, Stream *stream, Kernel *kernel){
+	Node opers[TOKEN_CAPACITY];
 	opers[0] = (Node){.type = NT_Global};
 	size_t opers_size = 1;
 
-	Value stack[64];
+	Value stack[TOKEN_CAPACITY];
 	size_t stack_size = 0;
-
-#define ERROR_VALUE(msg, pos) (Value){.type=DT_Error, .size=pos, .error=msg}
+	// where the argument or list element in each slot of the stack begins
+	size_t starts[TOKEN_CAPACITY];
 
 	ExpectValue:{
-		Node curr = get_token(line, &it);
+		Node curr = *token;
+		token += 1;
 		if (curr.type == NT_Error) return ERROR_VALUE(curr.error, curr.pos);
 		
 		switch (curr.type){
@@ -212,39 +3232,114 @@ static Value evaluate_line(const SymbolTable *symbols, const char *line){
 			opers[opers_size] = curr;
 			opers_size += 1;
 			goto ExpectValue;
-		case NT_Add:
+		case NT_OpenBracket:
+			curr.type = NT_List;
+			curr.size = stack_size;
+			starts[stack_size] = token->pos;
+			opers[opers_size] = curr;
+			opers_size += 1;
 			goto ExpectValue;
-		case NT_Subtract:
-			curr.type = NT_Minus;
+		case NT_Operator:
+			curr.type = curr.spelling->types[FX_Prefix];
+			if (curr.type == NT_Global) return ERROR_VALUE("expected value", curr.pos);
 			opers[opers_size] = curr;
 			opers_size += 1;
 			goto ExpectValue;
-		case NT_Identifier:
-			stack[stack_size] = get_identifier(symbols, curr.name, curr.size);
+		case NT_Identifier:{
+			if (token->type == NT_OpenPar){
+				const Function *func = get_function(curr.atom);
+				if (func == NULL) return ERROR_VALUE("function not found", curr.pos);
+				token += 1;
+				if (func->form != NULL){
+					stack[stack_size] = call_form(symbols, func, &token, stream);
+					if (stack[stack_size].type == DT_Error){
+						if (stack[stack_size].size == 0) stack[stack_size].size = curr.pos;
+						return stack[stack_size];
+					}
+					stack_size += 1;
+					goto ExpectOperator;
+				}
+				curr.type = NT_Call;
+				curr.function = func;
+				curr.size = stack_size;
+				starts[stack_size] = token->pos;
+				opers[opers_size] = curr;
+				opers_size += 1;
+				goto ExpectValue;
+			}
+			stack[stack_size] = kernel_variable(kernel, curr.atom);
+			if (stack[stack_size].type == DT_Void) stack[stack_size] = get_identifier(symbols, curr.atom);
 			if (stack[stack_size].type == DT_Error){
 				stack[stack_size].size = curr.pos;
 				return stack[stack_size];
 			}
 			stack_size += 1;
 			goto ExpectOperator;
+		}
+		case NT_Decimal:
+			stack[stack_size] = make_decimal((Decimal){.coefficient = curr.integer, .exponent = curr.exponent});
+			stack_size += 1;
+			goto ExpectOperator;
 		case NT_Number:
 			stack[stack_size].type = DT_Real;
+			stack[stack_size].units = curr.units;
 			stack[stack_size].real = curr.real;
 			stack_size += 1;
 			goto ExpectOperator;
+		case NT_ClosePar:
+			if (opers[opers_size-1].type == NT_Call && opers[opers_size-1].size == stack_size)
+				goto CallFunction;
+			return ERROR_VALUE("expected value", curr.pos);
+		case NT_CloseBracket:
+			if (opers[opers_size-1].type == NT_List && opers[opers_size-1].size == stack_size)
+				goto BuildList;
+			return ERROR_VALUE("expected value", curr.pos);
+		case NT_String:
+			return ERROR_VALUE("strings can only name files", curr.pos);
 		default:
 			return ERROR_VALUE("expected value", curr.pos);
 		}
 	}
 	
 	ExpectOperator:{
-		Node curr = get_token(line, &it);
+		Node curr = *token;
+		token += 1;
 		if (curr.type == NT_Error) return ERROR_VALUE(curr.error, curr.pos);
+		Fixity fixity = FX_Prefix;
+		if (curr.type == NT_Operator){
+			fixity = curr.spelling->types[FX_Infix] != NT_Global ? FX_Infix : FX_Postfix;
+			curr.type = curr.spelling->types[fixity];
+			if (curr.type == NT_Global) return ERROR_VALUE("expected operator", curr.pos);
+		}
 		
 		for (;;){
 			if (get_prec(opers[opers_size-1].type).right < get_prec(curr.type).left) break;
 			opers_size -= 1;
+			opers[opers_size].type = builtin_operator(opers[opers_size].type);
+			Units units = 0;
+			if (opers[opers_size].type != NT_Question){
+				size_t arg_count = operand_count(opers[opers_size].type);
+				const char *error = operator_units(opers[opers_size].type, stack + stack_size - arg_count, &units);
+				if (error != NULL) return ERROR_VALUE(error, opers[opers_size].pos);
+			}
+			Value typed = apply_typed_operator(kernel, opers[opers_size].type, stack, &stack_size);
+			if (typed.type == DT_Error){
+				typed.size = opers[opers_size].pos;
+				return typed;
+			}
+			if (typed.type != DT_Void){
+				if (typed.type == DT_Lanes) stack[stack_size-1].units = units;
+				continue;
+			}
+			if (opers[opers_size].type != NT_Question){
+				size_t arg_count = operand_count(opers[opers_size].type);
+				demote_bigs(stack + stack_size - arg_count, arg_count);
+			}
 			switch (opers[opers_size].type){
+			case NT_Plus:
+				if (stack[stack_size-1].type != DT_Real)
+					return ERROR_VALUE("wrong data type", opers[opers_size].pos);
+				break;
 			case NT_Minus:
 				if (stack[stack_size-1].type != DT_Real)
 					return ERROR_VALUE("wrong data type", opers[opers_size].pos);
@@ -279,31 +3374,103 @@ static Value evaluate_line(const SymbolTable *symbols, const char *line){
 					return ERROR_VALUE("negative power base", opers[opers_size].pos);
 				stack[stack_size-2].real = pow(stack[stack_size-2].real, stack[stack_size-1].real);
 				stack_size -= 1; break;
-			default: fprintf(stderr, "ERROR: broken parser\n"); exit(1);
+			case NT_Less:
+			case NT_LessEqual:
+			case NT_Greater:
+			case NT_GreaterEqual:
+			case NT_Equal:
+			case NT_NotEqual:
+			case NT_And:
+			case NT_Or:
+				if (stack[stack_size-1].type != DT_Real || stack[stack_size-2].type != DT_Real)
+					return ERROR_VALUE("wrong data type", opers[opers_size].pos);
+				stack[stack_size-2].real = compare(
+					opers[opers_size].type, stack[stack_size-2].real, stack[stack_size-1].real
+				);
+				stack_size -= 1; break;
+			case NT_Colon:
+				if (
+					stack[stack_size-1].type != DT_Real ||
+					stack[stack_size-2].type != DT_Real ||
+					stack[stack_size-3].type != DT_Real
+				) return ERROR_VALUE("wrong data type", opers[opers_size].pos);
+				stack[stack_size-3].real = select_real(
+					stack[stack_size-3].real, stack[stack_size-2].real, stack[stack_size-1].real
+				);
+				stack_size -= 2; break;
+			case NT_Question:
+				return ERROR_VALUE("expected ':'", curr.pos);
+			default:{
+				if (opers[opers_size].type < NT_User){
+					fprintf(stderr, "ERROR: broken parser\n");
+					exit(1);
+				}
+				Value res = apply_user_operator(opers[opers_size].type, stack, &stack_size, stream);
+				if (res.type == DT_Error){
+					res.size = opers[opers_size].pos;
+					return res;
+				}
+			}
 			}
+			if (stack[stack_size-1].type == DT_Real) stack[stack_size-1].units = units;
 		}
 
-		switch (curr.type){
-		case NT_Add:
-		case NT_Subtract:
-		case NT_Multiply:
-		case NT_Divide:
-		case NT_Power:
+		if (fixity == FX_Infix){
 			opers[opers_size] = curr;
 			opers_size += 1;
 			goto ExpectValue;
-		case NT_Factorial:
-			if (stack[stack_size-1].type != DT_Real)
-				return ERROR_VALUE("wrong data type", curr.pos);
-			if (stack[stack_size-1].real < 0.0)
-				return ERROR_VALUE("factorial of negative number", curr.pos);
-			stack[stack_size-1].real = tgamma(1.0 + stack[stack_size-1].real);
+		}
+		if (fixity == FX_Postfix){
+			Units units;
+			const char *error = operator_units(curr.type, stack + stack_size - operand_count(curr.type), &units);
+			if (error != NULL) return ERROR_VALUE(error, curr.pos);
+			Value typed = apply_typed_operator(kernel, curr.type, stack, &stack_size);
+			if (typed.type == DT_Error){
+				typed.size = curr.pos;
+				return typed;
+			}
+			if (typed.type != DT_Void) goto ExpectOperator;
+			demote_bigs(stack + stack_size-1, 1);
+			if (curr.type == NT_Factorial){
+				if (stack[stack_size-1].type != DT_Real)
+					return ERROR_VALUE("wrong data type", curr.pos);
+				if (stack[stack_size-1].real < 0.0)
+					return ERROR_VALUE("factorial of negative number", curr.pos);
+				stack[stack_size-1].real = tgamma(1.0 + stack[stack_size-1].real);
+				goto ExpectOperator;
+			}
+			Value res = apply_user_operator(curr.type, stack, &stack_size, stream);
+			if (res.type == DT_Error){
+				res.size = curr.pos;
+				return res;
+			}
 			goto ExpectOperator;
+		}
+
+		switch (curr.type){
+		case NT_Question:
+			opers[opers_size] = curr;
+			opers_size += 1;
+			goto ExpectValue;
+		case NT_Colon:
+			if (opers[opers_size-1].type != NT_Question)
+				return ERROR_VALUE("unexpected ':'", curr.pos);
+			opers[opers_size-1] = curr;
+			goto ExpectValue;
 		case NT_Newline:
 			if (opers_size != 1)
 				return ERROR_VALUE("parenthesis not closed", curr.pos);
 			return stack[0];
+		case NT_Comma:
+			if (opers[opers_size-1].type != NT_Call && opers[opers_size-1].type != NT_List)
+				return ERROR_VALUE("unexpected comma", curr.pos);
+			starts[stack_size] = token->pos;
+			goto ExpectValue;
+		case NT_CloseBracket:
+			if (opers[opers_size-1].type == NT_List) goto BuildList;
+			return ERROR_VALUE("mismatched bracket", curr.pos);
 		case NT_ClosePar:
+			if (opers[opers_size-1].type == NT_Call) goto CallFunction;
 			if (opers[opers_size-1].type != NT_OpenPar)
 				return ERROR_VALUE("mismatched parenthesis", curr.pos);
 			opers_size -= 1;
@@ -312,28 +3479,767 @@ static Value evaluate_line(const SymbolTable *symbols, const char *line){
 			return ERROR_VALUE("expected operator", curr.pos);
 		}
 	}
-#undef ERROR_VALUE
+
+	CallFunction:{
+		opers_size -= 1;
+		Node call = opers[opers_size];
+		for (size_t i=call.size; i!=stack_size; i+=1){
+			if (value_units(stack[i]) != 0) return ERROR_VALUE("expected a value without units", starts[i]);
+		}
+		Value res = trace_call(kernel, call.function, stack + call.size, stack_size - call.size);
+		if (res.type == DT_Void)
+			res = call_function(call.function, stack + call.size, stack_size - call.size, stream);
+		if (res.type == DT_Error){
+			res.size = call.pos;
+			return res;
+		}
+		stack_size = call.size;
+		stack[stack_size] = res;
+		stack_size += 1;
+		goto ExpectOperator;
+	}
+
+	BuildList:{
+		opers_size -= 1;
+		Node list = opers[opers_size];
+		Value res = make_vector(stack_size - list.size);
+		demote_decimals(stack + list.size, res.length);
+		for (size_t i=0; i!=res.length; i+=1){
+			if (stack[list.size + i].type != DT_Real) return ERROR_VALUE("wrong data type", starts[list.size + i]);
+			if (stack[list.size + i].units != 0) return ERROR_VALUE("expected a value without units", starts[list.size + i]);
+			res.reals[i] = stack[list.size + i].real;
+		}
+		stack_size = list.size;
+		stack[stack_size] = res;
+		stack_size += 1;
+		goto ExpectOperator;
+	}
+}
+
+// evaluates the tokens [begin, end) of a line as if they were a line of their own
+static Value evaluate_range(const SymbolTable *symbols, const Node *begin, const Node *end, Stream *stream, Kernel *kernel){
+	Node tokens[TOKEN_CAPACITY];
+	memcpy(tokens, begin, (end - begin) * sizeof(Node));
+	tokens[end - begin] = (Node){.type = NT_Newline, .pos = end->pos};
+	return evaluate_tokens(symbols, tokens, stream, kernel);
 }
 
+static Value compile_kernel(
+	const SymbolTable *symbols, const Node *begin, const Node *end, const uint32_t *vars, size_t var_count
+){
+	Kernel *kernel = temp_alloc(sizeof(Kernel));
+	*kernel = (Kernel){.single = single_precision, .var_count = var_count, .reg_count = var_count};
+	memcpy(kernel->vars, vars, var_count * sizeof(uint32_t));
+	Value res = evaluate_range(symbols, begin, end, NULL, kernel);
+	if (res.type == DT_Error) return res;
+	if (value_units(res) != 0) return ERROR_VALUE("expected a value without units", begin->pos);
+	demote_decimals(&res, 1);
+	if (res.type == DT_Real){
+		const char *error = NULL;
+		res = (Value){.type = DT_Lanes, .reg = kernel_operand(kernel, res, &error)};
+		if (error != NULL) return ERROR_VALUE(error, begin->pos);
+	}
+	if (res.type != DT_Lanes) return ERROR_VALUE("wrong data type", begin->pos);
+	kernel->result = res.reg;
+	return (Value){.type = DT_Kernel, .kernel = kernel};
+}
 
+#define FORM_ARG_CAPACITY 40
 
-int main(){
-	char buffer[256];
-	SymbolTable symbols = {0};
-	set_identifier(&symbols, "e", 1, (Value){.type=DT_Real, .real=M_E});
-	set_identifier(&symbols, "pi", 2, (Value){.type=DT_Real, .real=M_PI});
+static bool is_name(const char *name){
+	if (!is_character(name[0])) return false;
+	for (size_t i=1; name[i]!='\0'; i+=1){
+		if (!is_alnum(name[i])) return false;
+	}
+	return true;
+}
+
+// Columns are named by the first line of the file, or x and y when there are
+// two of them and x1, x2, ... otherwise. They become variables after the ones
+// named in the form.
+static Value load_dataset(uint32_t path, uint32_t *vars, size_t *var_count){
+	Dataset *d = temp_alloc(sizeof(Dataset));
+	const char *error = csv_load(atom_name(path), d);
+	if (error != NULL) return ERROR_VALUE(error, 0);
+	temp_adopt(d->columns[0]);
+	if (*var_count + d->column_count > KERNEL_VAR_CAPACITY) return ERROR_VALUE("too many variables", 0);
+	for (size_t c=0; c!=d->column_count; c+=1){
+		char name[CSV_NAME_CAPACITY + 1];
+		if (d->has_names) strcpy(name, d->names[c]);
+		else if (d->column_count == 2) strcpy(name, c == 0 ? "x" : "y");
+		else snprintf(name, sizeof(name), "x%zu", c+1);
+		if (!is_name(name)) return ERROR_VALUE("column names must be identifiers", 0);
+		vars[*var_count] = intern(name, strlen(name));
+		if (vars[*var_count] == ATOM_UNKNOWN) return ERROR_VALUE("too many identifiers", 0);
+		*var_count += 1;
+	}
+	return (Value){.type = DT_Data, .dataset = d};
+}
+
+// A form has one letter per argument: E for an expression that is compiled
+// over the variables, V for the name of a variable, which comes with its value
+// when it has one, R for a value, D for the file name of a CSV table whose
+// columns are variables as well and F for the name of a file to write. A letter
+// followed by * stands for any number of arguments of that kind, when several
+// letters have one they all get the same number of arguments.
+static bool match_form(const char *form, size_t arg_count, char *kinds){
+	size_t fixed = 0;
+	size_t variadic = 0;
+	for (const char *c=form; *c!='\0'; c+=1){
+		if (*c == '*') variadic += 1;
+		else fixed += 1;
+	}
+	fixed -= variadic;
+	if (arg_count < fixed) return false;
+	if (variadic == 0 ? arg_count != fixed : (arg_count - fixed) % variadic != 0) return false;
+	size_t repeat = variadic ? (arg_count - fixed) / variadic : 0;
+	size_t n = 0;
+	for (const char *c=form; *c!='\0'; c+=1){
+		if (c[1] == '*'){
+			for (size_t i=0; i!=repeat; i+=1) kinds[n++] = *c;
+			c += 1;
+		} else{
+			kinds[n++] = *c;
+		}
+	}
+	return true;
+}
+
+// The arguments of a form are split at the top level commas before anything is
+// evaluated, because expressions can only be compiled once every variable is
+// known. On return the iterator is past the closing parenthesis.
+static Value call_form(const SymbolTable *symbols, const Function *func, const Node **iter, Stream *stream){
+	const Node *bounds[FORM_ARG_CAPACITY + 1];
+	size_t arg_count = 0;
+	const Node *token = *iter;
+	bounds[0] = token;
+	for (size_t depth=0;; token+=1){
+		if (token->type == NT_Error) return ERROR_VALUE(token->error, token->pos);
+		if (token->type == NT_Newline) return ERROR_VALUE("parenthesis not closed", token->pos);
+		if (token->type == NT_OpenPar || token->type == NT_OpenBracket) depth += 1;
+		if (depth == 0 && (token->type == NT_Comma || token->type == NT_ClosePar)){
+			if (token == bounds[arg_count]){
+				if (token->type == NT_ClosePar && arg_count == 0) break;
+				return ERROR_VALUE("expected value", token->pos);
+			}
+			if (arg_count == FORM_ARG_CAPACITY) return ERROR_VALUE("too many arguments", token->pos);
+			arg_count += 1;
+			bounds[arg_count] = token + 1;
+			if (token->type == NT_ClosePar) break;
+		}
+		if (token->type == NT_ClosePar || token->type == NT_CloseBracket) depth -= 1;
+	}
+	*iter = token + 1;
+
+	char kinds[FORM_ARG_CAPACITY];
+	if (!match_form(func->form, arg_count, kinds)) return ERROR_VALUE("wrong number of arguments", 0);
+
+	Value args[FORM_ARG_CAPACITY];
+	uint32_t vars[KERNEL_VAR_CAPACITY];
+	size_t var_count = 0;
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (kinds[i] != 'V') continue;
+		if (bounds[i+1] - bounds[i] != 2 || bounds[i]->type != NT_Identifier)
+			return ERROR_VALUE("expected variable name", bounds[i]->pos);
+		if (var_count == KERNEL_VAR_CAPACITY) return ERROR_VALUE("too many variables", bounds[i]->pos);
+		vars[var_count] = bounds[i]->atom;
+		var_count += 1;
+		args[i] = symbols->values[bounds[i]->atom];
+		if (args[i].type < DT_Real) args[i] = (Value){.type = DT_Void};
+		if (value_units(args[i]) != 0) return ERROR_VALUE("expected a value without units", bounds[i]->pos);
+	}
+	for (size_t i=0; i!=arg_count; i+=1){
+		if (kinds[i] != 'D') continue;
+		if (bounds[i+1] - bounds[i] != 2 || bounds[i]->type != NT_String)
+			return ERROR_VALUE("expected file name", bounds[i]->pos);
+		args[i] = load_dataset(bounds[i]->atom, vars, &var_count);
+		if (args[i].type == DT_Error){
+			args[i].size = bounds[i]->pos;
+			return args[i];
+		}
+	}
+
+	for (size_t i=0; i!=arg_count; i+=1){
+		const Node *end = bounds[i+1] - 1;
+		if (kinds[i] == 'F'){
+			if (bounds[i+1] - bounds[i] != 2 || bounds[i]->type != NT_String)
+				return ERROR_VALUE("expected file name", bounds[i]->pos);
+			args[i] = (Value){.type = DT_Path, .string = atom_name(bounds[i]->atom)};
+		} else if (kinds[i] == 'E')
+			args[i] = compile_kernel(symbols, bounds[i], end, vars, var_count);
+		else if (kinds[i] == 'R')
+			args[i] = evaluate_range(symbols, bounds[i], end, stream, NULL);
+		if (args[i].type == DT_Error) return args[i];
+		if (value_units(args[i]) != 0) return ERROR_VALUE("expected a value without units", bounds[i]->pos);
+		demote_decimals(args + i, 1);
+	}
+	return func->call(args, stream);
+}
+
+
+
+static Value evaluate_line(const SymbolTable *symbols, const char *line, Stream *stream){
+	Node tokens[TOKEN_CAPACITY];
+	tokenize(line, line, tokens);
+	return evaluate_tokens(symbols, tokens, stream, NULL);
+}
+
+static bool is_command(Node first){
+	return
+		is_keyword(first, BA_infix) || is_keyword(first, BA_prefix) ||
+		is_keyword(first, BA_postfix) || is_keyword(first, BA_symbols);
+}
+
+static void print_symbol(uint32_t atom, void *data){
+	const SymbolTable *symbols = data;
+	const char *name = atom_name(atom);
+	if (symbols->values[atom].type >= DT_Real){
+		printf("%s = ", name);
+		print_value(symbols->values[atom]);
+		putchar('\n');
+	}
+	if (atom >= BA_Count) return;
+	if (builtin_kinds[atom] == BK_Constant) printf("%s = %lf\n", name, constants[atom]);
+	if (builtin_kinds[atom] != BK_Function) return;
+	if (functions[atom].form == NULL){
+		printf("%s/%u\n", name, functions[atom].arg_count);
+		return;
+	}
+	// forms print with a word for each kind of argument, as in sample(expr,
+	// var, value, value, value)
+	printf("%s(", name);
+	for (const char *c=functions[atom].form; *c!='\0'; c+=1){
+		if (*c == '*'){
+			fputs("...", stdout);
+			continue;
+		}
+		if (c != functions[atom].form) fputs(", ", stdout);
+		switch (*c){
+		case 'E': fputs("expr", stdout); break;
+		case 'V': fputs("var", stdout); break;
+		case 'R': fputs("value", stdout); break;
+		case 'D': fputs("\"table.csv\"", stdout); break;
+		case 'F': fputs("\"file\"", stdout); break;
+		}
+	}
+	puts(")");
+}
+
+// symbols [name | prefix*]
+static Value list_symbols(SymbolTable *symbols, const char *line){
+	const char *it = line;
+	get_token(line, &it);
+	while (*it==' ' || *it=='\t') it += 1;
+	const char *prefix = it;
+	while (is_alnum(*it)) it += 1;
+	size_t size = it - prefix;
+	bool is_prefix = size == 0;
+	if (*it == '*'){
+		it += 1;
+		is_prefix = true;
+	}
+	Node end = get_token(line, &it);
+	if (end.type != NT_Newline) return ERROR_VALUE("expected end of line", end.pos);
+
+	SymbolTrie *trie = get_symbol_trie(symbols);
+	uint32_t node = trie_find(trie, prefix, size);
+	if (size != 0 && node == 0) return (Value){.type = DT_Void};
+	if (is_prefix){
+		trie_walk(trie, node, print_symbol, symbols);
+	} else if (
+		trie->nodes[node].atom != NO_ATOM &&
+		trie->nodes[node].label_begin + trie->nodes[node].label_size == size
+	){
+		print_symbol(trie->nodes[node].atom, symbols);
+	}
+	return (Value){.type = DT_Void};
+}
+
+static bool is_assignment(const Node *tokens){
+	return tokens[0].type == NT_Identifier && tokens[1].type == NT_Assign;
+}
+
+static Value execute_line(SymbolTable *symbols, const char *line){
+	temp_reset();
+	Node tokens[TOKEN_CAPACITY];
+	tokenize(line, line, tokens);
+	if (is_keyword(tokens[0], BA_infix))   return declare_operator(line, FX_Infix);
+	if (is_keyword(tokens[0], BA_prefix))  return declare_operator(line, FX_Prefix);
+	if (is_keyword(tokens[0], BA_postfix)) return declare_operator(line, FX_Postfix);
+	if (is_keyword(tokens[0], BA_symbols)) return list_symbols(symbols, line);
+
+	if (is_assignment(tokens)){
+		uint32_t atom = tokens[0].atom;
+		if (atom < BA_Count && builtin_kinds[atom] == BK_Constant)
+			return ERROR_VALUE("cannot assign to a builtin constant", tokens[0].pos);
+		Value res = evaluate_tokens(symbols, tokens+2, NULL, NULL);
+		if (res.type != DT_Error) set_identifier(symbols, atom, res);
+		return res;
+	}
+	return evaluate_tokens(symbols, tokens, NULL, NULL);
+}
+
+#define HISTORY_CAPACITY 128
+#define PREVIEW_CAPACITY 256
+#define PREVIEW_TIMEOUT_MS 50
+
+// tokens of the line being edited are kept between keystrokes, ends[i] is the
+// offset just past tokens[i], and the preview of the line until it is edited
+typedef struct LineEditor{
+	char line[256];
+	size_t size;
+	size_t cursor;
+	size_t token_count;
+	Node tokens[TOKEN_CAPACITY];
+	uint16_t ends[TOKEN_CAPACITY];
+	bool edited;
+	size_t previewed_count;
+	Node previewed[TOKEN_CAPACITY];
+	size_t preview_size;
+	char preview[PREVIEW_CAPACITY];
+	size_t history_count;
+	size_t history_index;
+	char *history[HISTORY_CAPACITY];
+	struct termios cooked;
+} LineEditor;
+
+// Relexes after the range [pos, old_end) was replaced by [pos, new_end). Lexing
+// starts a few tokens before the edit, because strtod can look past the end of
+// the number it returns, and stops as soon as a new token starts where an old
+// token behind the edit started, since the rest of the line lexes the same.
+static void relex(LineEditor *ed, size_t pos, size_t old_end, size_t new_end){
+	long delta = (long)new_end - (long)old_end;
+	size_t first = 0;
+	while (
+		first != ed->token_count &&
+		ed->tokens[first].type != NT_Newline &&
+		ed->tokens[first].type != NT_Error &&
+		ed->ends[first] < pos
+	) first += 1;
+	first = first > 2 ? first - 2 : 0;
+
+	Node fresh[TOKEN_CAPACITY];
+	uint16_t fresh_ends[TOKEN_CAPACITY];
+	size_t count = 0;
+	size_t old = first;
+	const char *it = ed->line + (first != 0 ? ed->ends[first-1] : 0);
+	for (;;){
+		if (first + count == TOKEN_CAPACITY-1){
+			fresh[count] = (Node){.type = NT_Error, .pos = it - ed->line, .error = "line too long"};
+			fresh_ends[count] = it - ed->line;
+			count += 1;
+			break;
+		}
+		lex_without_interning = true;
+		Node token = get_token(ed->line, &it);
+		lex_without_interning = false;
+		while (old != ed->token_count && (long)ed->tokens[old].pos + delta < (long)token.pos) old += 1;
+		if (
+			old != ed->token_count &&
+			ed->tokens[old].pos >= old_end &&
+			(long)ed->tokens[old].pos + delta == (long)token.pos
+		){
+			for (; old!=ed->token_count; old+=1){
+				if (first + count == TOKEN_CAPACITY) break;
+				fresh[count] = ed->tokens[old];
+				fresh[count].pos += delta;
+				fresh_ends[count] = ed->ends[old] + delta;
+				count += 1;
+			}
+			break;
+		}
+		fresh[count] = token;
+		fresh_ends[count] = it - ed->line;
+		count += 1;
+		if (token.type == NT_Newline || token.type == NT_Error) break;
+	}
+	memcpy(ed->tokens + first, fresh, count * sizeof(Node));
+	memcpy(ed->ends + first, fresh_ends, count * sizeof(uint16_t));
+	ed->token_count = first + count;
+}
+
+static bool editor_insert(LineEditor *ed, const char *text, size_t size){
+	if (ed->size + size >= sizeof(ed->line)) return false;
+	memmove(ed->line + ed->cursor + size, ed->line + ed->cursor, ed->size - ed->cursor + 1);
+	memcpy(ed->line + ed->cursor, text, size);
+	ed->size += size;
+	relex(ed, ed->cursor, ed->cursor, ed->cursor + size);
+	ed->cursor += size;
+	ed->edited = true;
+	return true;
+}
+
+static void editor_erase(LineEditor *ed, size_t begin, size_t end){
+	if (begin >= end) return;
+	memmove(ed->line + begin, ed->line + end, ed->size - end + 1);
+	ed->size -= end - begin;
+	relex(ed, begin, end, begin);
+	ed->cursor = begin;
+	ed->edited = true;
+}
+
+static void editor_set_line(LineEditor *ed, const char *text){
+	ed->size = strlen(text);
+	memcpy(ed->line, text, ed->size + 1);
+	ed->cursor = ed->size;
+	ed->token_count = 0;
+	relex(ed, 0, 0, 0);
+	ed->edited = true;
+	ed->previewed_count = 0;
+}
+
+// whether the tokens differ from the ones of the last preview other than in
+// their positions, lexing starts every node from zeros so the unions compare
+static bool editor_tokens_changed(const LineEditor *ed){
+	if (ed->token_count != ed->previewed_count) return true;
+	for (size_t i=0; i!=ed->token_count; i+=1){
+		const Node *a = ed->tokens + i, *b = ed->previewed + i;
+		if (a->type != b->type || a->size != b->size || a->integer != b->integer || a->exponent != b->exponent)
+			return true;
+	}
+	return false;
+}
+
+static bool has_form_call(const Node *tokens){
+	for (size_t i=0; tokens[i].type!=NT_Newline && tokens[i].type!=NT_Error; i+=1){
+		if (tokens[i].type != NT_Identifier || tokens[i+1].type != NT_OpenPar) continue;
+		const Function *func = get_function(tokens[i].atom);
+		if (func != NULL && func->form != NULL) return true;
+	}
+	return false;
+}
+
+// The preview never assigns, never runs commands and skips forms, which read
+// and write files. The line is evaluated in a child process that prints its
+// value into a pipe, so nothing the evaluation does reaches the repl and a line
+// that takes longer than PREVIEW_TIMEOUT_MS is killed. Only as much of the
+// value is read as fits the preview, a value that was cut off ends in "...".
+static void editor_preview(LineEditor *ed, const SymbolTable *symbols){
+	ed->preview_size = 0;
+	if (is_command(ed->tokens[0]) || has_form_call(ed->tokens)) return;
+	int fds[2];
+	if (pipe(fds) != 0) return;
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0){
+		close(fds[0]);
+		close(fds[1]);
+		return;
+	}
+	if (pid == 0){
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		if (freopen("/dev/null", "w", stderr) == NULL) _exit(1);
+		Value res = evaluate_tokens(symbols, is_assignment(ed->tokens) ? ed->tokens+2 : ed->tokens, NULL, NULL);
+		if (res.type >= DT_Real) print_value(res);
+		fflush(stdout);
+		_exit(0);
+	}
+	close(fds[1]);
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	size_t size = 0;
+	bool complete = false;
+	while (size != PREVIEW_CAPACITY){
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long elapsed = (now.tv_sec - start.tv_sec)*1000 + (now.tv_nsec - start.tv_nsec)/1000000;
+		struct pollfd p = {.fd = fds[0], .events = POLLIN};
+		if (elapsed >= PREVIEW_TIMEOUT_MS || poll(&p, 1, PREVIEW_TIMEOUT_MS - elapsed) <= 0) break;
+		ssize_t n = read(fds[0], ed->preview + size, PREVIEW_CAPACITY - size);
+		if (n <= 0){
+			complete = n == 0;
+			break;
+		}
+		size += n;
+	}
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	close(fds[0]);
+	if (size == 0) return;
+	if (!complete){
+		size = size < PREVIEW_CAPACITY-3 ? size : PREVIEW_CAPACITY-3;
+		memcpy(ed->preview + size, "...", 3);
+		size += 3;
+	}
+	ed->preview_size = size;
+}
+
+// the line is evaluated again only after it was edited, the preview is cut to
+// what fits in the rest of the terminal line
+static void editor_refresh(LineEditor *ed, const SymbolTable *symbols){
+	if (ed->edited && editor_tokens_changed(ed)){
+		editor_preview(ed, symbols);
+		memcpy(ed->previewed, ed->tokens, ed->token_count * sizeof(Node));
+		ed->previewed_count = ed->token_count;
+	}
+	ed->edited = false;
+	struct winsize ws;
+	size_t width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col != 0 ? ws.ws_col : 80;
+	printf("\r%s\x1b[K", ed->line);
+	if (ed->preview_size != 0 && ed->size + 8 < width){
+		size_t room = width - ed->size - 5;
+		printf("\x1b[2m  = ");
+		if (ed->preview_size <= room) printf("%.*s", (int)ed->preview_size, ed->preview);
+		else printf("%.*s...", (int)(room - 3), ed->preview);
+		printf("\x1b[0m");
+	}
+	printf("\r");
+	if (ed->cursor != 0) printf("\x1b[%zuC", ed->cursor);
+	fflush(stdout);
+}
+
+static void print_completion(uint32_t atom, void *data){
+	printf("%s  ", atom_name(atom));
+}
+
+static void editor_complete(LineEditor *ed, SymbolTable *symbols){
+	size_t begin = ed->cursor;
+	while (begin != 0 && is_alnum(ed->line[begin-1])) begin -= 1;
+	if (begin == ed->cursor || !is_character(ed->line[begin])){
+		putchar('\a');
+		return;
+	}
+	SymbolTrie *trie = get_symbol_trie(symbols);
+	size_t prefix_size = ed->cursor - begin;
+	uint32_t node = trie_find(trie, ed->line + begin, prefix_size);
+	if (node == 0){
+		putchar('\a');
+		return;
+	}
+	size_t common_size = trie_common_size(trie, node);
+	if (common_size > prefix_size){
+		const char *name = atom_name(trie->nodes[node].label_atom);
+		editor_insert(ed, name + prefix_size, common_size - prefix_size);
+		return;
+	}
+	if (trie->nodes[node].child == 0) return;
+	printf("\r\n");
+	trie_walk(trie, node, print_completion, NULL);
+	printf("\r\n");
+}
+
+static void editor_raw_mode(LineEditor *ed){
+	tcgetattr(STDIN_FILENO, &ed->cooked);
+	struct termios raw = ed->cooked;
+	raw.c_iflag &= ~(ICRNL | IXON);
+	raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+}
+
+static void editor_add_history(LineEditor *ed){
+	if (ed->size == 0) return;
+	if (ed->history_count == HISTORY_CAPACITY){
+		free(ed->history[0]);
+		memmove(ed->history, ed->history+1, (HISTORY_CAPACITY-1) * sizeof(char *));
+		ed->history_count -= 1;
+	}
+	ed->history[ed->history_count] = strdup(ed->line);
+	ed->history_count += 1;
+}
+
+static char *read_line(LineEditor *ed, SymbolTable *symbols, char *buffer, size_t buffer_size){
+	editor_set_line(ed, "");
+	ed->history_index = ed->history_count;
+	editor_raw_mode(ed);
+	editor_refresh(ed, symbols);
 
 	for (;;){
+		char c;
+		if (read(STDIN_FILENO, &c, 1) != 1) c = 4;
+		switch (c){
+		case '\r':
+		case '\n':
+			printf("\r%s\x1b[K\r\n", ed->line);
+			tcsetattr(STDIN_FILENO, TCSANOW, &ed->cooked);
+			editor_add_history(ed);
+			snprintf(buffer, buffer_size, "%s\n", ed->line);
+			return buffer;
+		case 4:    // ctrl-d
+			if (ed->size == 0){
+				tcsetattr(STDIN_FILENO, TCSANOW, &ed->cooked);
+				putchar('\n');
+				return NULL;
+			}
+			editor_erase(ed, ed->cursor, ed->cursor + (ed->cursor != ed->size));
+			break;
+		case 3:    // ctrl-c
+			printf("^C\r\n");
+			editor_set_line(ed, "");
+			break;
+		case 127:
+		case 8:
+			if (ed->cursor != 0) editor_erase(ed, ed->cursor-1, ed->cursor);
+			break;
+		case 21:   // ctrl-u
+			editor_erase(ed, 0, ed->cursor);
+			break;
+		case 11:   // ctrl-k
+			editor_erase(ed, ed->cursor, ed->size);
+			break;
+		case 1:    // ctrl-a
+			ed->cursor = 0;
+			break;
+		case 5:    // ctrl-e
+			ed->cursor = ed->size;
+			break;
+		case '\t':
+			editor_complete(ed, symbols);
+			break;
+		case 27:{
+			char seq[3] = {0};
+			if (read(STDIN_FILENO, seq, 1) != 1 || seq[0] != '[') break;
+			if (read(STDIN_FILENO, seq+1, 1) != 1) break;
+			switch (seq[1]){
+			case 'A':
+			case 'B':
+				if (seq[1] == 'A' && ed->history_index != 0) ed->history_index -= 1;
+				else if (seq[1] == 'B' && ed->history_index != ed->history_count) ed->history_index += 1;
+				else break;
+				editor_set_line(ed, ed->history_index == ed->history_count ? "" : ed->history[ed->history_index]);
+				break;
+			case 'C':
+				if (ed->cursor != ed->size) ed->cursor += 1;
+				break;
+			case 'D':
+				if (ed->cursor != 0) ed->cursor -= 1;
+				break;
+			case 'H':
+				ed->cursor = 0;
+				break;
+			case 'F':
+				ed->cursor = ed->size;
+				break;
+			case '3':
+				if (read(STDIN_FILENO, seq+2, 1) == 1 && seq[2] == '~')
+					editor_erase(ed, ed->cursor, ed->cursor + (ed->cursor != ed->size));
+				break;
+			}
+			break;
+		}
+		default:
+			if (' ' <= c && c <= '~' && !editor_insert(ed, &c, 1)) putchar('\a');
+		}
+		editor_refresh(ed, symbols);
+	}
+}
+
+// every input line is one sample, bound to x before the stream expression runs
+static int run_stream(SymbolTable *symbols, const char *expr){
+	static Stream stream;
+	char buffer[256];
+	Node tokens[TOKEN_CAPACITY];
+	tokenize(expr, expr, tokens);
+	for (size_t sample=1;; sample+=1){
 		char *line = fgets(buffer, sizeof(buffer), stdin);
 		if (line == NULL) break;
-		Value res = evaluate_line(&symbols, line);
+		temp_reset();
+		Value x = evaluate_line(symbols, line, NULL);
+		if (x.type == DT_Error){
+			fprintf(stderr, "ERROR: sample %zu: %s\n", sample, x.error);
+			continue;
+		}
+		set_identifier(symbols, BA_x, x);
+		stream.window_count = 0;
+		Value res = evaluate_tokens(symbols, tokens, &stream, NULL);
+		if (res.type == DT_Error){
+			fprintf(stderr, "ERROR: sample %zu: %s\n", sample, res.error);
+			continue;
+		}
+		print_value(res);
+		putchar('\n');
+	}
+	return 0;
+}
+
+int main(int argc, char **argv){
+	char buffer[256];
+	static SymbolTable symbols;
+	init_operators();
+
+	const char *stream_expr = NULL;
+	uint64_t seed = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = cpus < 1 ? 1 : cpus > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : cpus;
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-s") == 0 && i+1 != argc){
+			i += 1;
+			stream_expr = argv[i];
+			continue;
+		}
+		if (strcmp(argv[i], "--seed") == 0 && i+1 != argc){
+			i += 1;
+			seed = strtoull(argv[i], NULL, 0);
+			continue;
+		}
+		if (strcmp(argv[i], "--threads") == 0 && i+1 != argc){
+			i += 1;
+			long count = strtol(argv[i], NULL, 0);
+			threads = count < 1 ? 1 : count > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : count;
+			continue;
+		}
+		if (strcmp(argv[i], "--overflow") == 0 && i+1 != argc){
+			i += 1;
+			if (strcmp(argv[i], "saturate") == 0 || strcmp(argv[i], "wrap") == 0){
+				fixed_overflow = strcmp(argv[i], "wrap") == 0 ? FO_Wrap : FO_Saturate;
+				continue;
+			}
+		}
+		if (strcmp(argv[i], "--precision") == 0 && i+1 != argc){
+			i += 1;
+			if (strcmp(argv[i], "single") == 0 || strcmp(argv[i], "double") == 0){
+				single_precision = strcmp(argv[i], "single") == 0;
+				continue;
+			}
+		}
+		if (strcmp(argv[i], "--decimal") == 0){
+			decimal_literals = true;
+			continue;
+		}
+		if (strcmp(argv[i], "--rounding") == 0 && i+1 != argc){
+			i += 1;
+			DecimalRounding mode = 0;
+			while (mode != DR_Count && strcmp(argv[i], decimal_rounding_names[mode]) != 0) mode += 1;
+			if (mode != DR_Count){
+				decimal_rounding = mode;
+				continue;
+			}
+		}
+		fprintf(stderr, "usage: %s [-s expression] [--seed number] [--threads count] [--precision single|double] [--overflow saturate|wrap]"
+			" [--decimal] [--rounding half-even|half-up|down|up|floor|ceiling]\n", argv[0]);
+		return 1;
+	}
+	rng = random_init(seed, 0);
+	parallel_threads = threads;
+	if (stream_expr != NULL) return run_stream(&symbols, stream_expr);
+
+	static LineEditor editor;
+	const char *term = getenv("TERM");
+	bool interactive = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && !(term && strcmp(term, "dumb") == 0);
+
+	for (;;){
+		char *line = interactive
+			? read_line(&editor, &symbols, buffer, sizeof(buffer))
+			: fgets(buffer, sizeof(buffer), stdin);
+		if (line == NULL) break;
+		Value res = execute_line(&symbols, line);
 		switch (res.type){
 		case DT_Error:
 			for (size_t i=0; i!=res.size; i+=1) putchar(buffer[i]=='\t' ? '\t' : ' ');
 			printf("^\nERROR: %s\n", res.error);
 			break;
 		case DT_Real:
-			printf("= %lf\n", res.real);
+		case DT_Vector:
+		case DT_Big:
+		case DT_Poly:
+		case DT_Modular:
+		case DT_Fixed:
+		case DT_Decimal:
+			printf("= ");
+			print_value(res);
+			putchar('\n');
 			break;
 		}
 	}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "utils.h"
+#include "parallel.h"
+#include "primes.h"
+
+// Arithmetic modulo any n from 2 to 2^63. Odd moduli go through Montgomery
+// multiplication, even ones through a 128 bit remainder. Residues are always
+// kept in their plain form in [0, n).
+
+typedef struct Modulus{
+	uint64_t n;
+	bool odd;
+	Montgomery mont;
+} Modulus;
+
+static Modulus modulus_init(uint64_t n){
+	Modulus m = {.n = n, .odd = n % 2 == 1};
+	if (m.odd) m.mont = montgomery_init(n);
+	return m;
+}
+
+static uint64_t mod_add(const Modulus *m, uint64_t a, uint64_t b){
+	return a >= m->n - b ? a - (m->n - b) : a + b;
+}
+
+static uint64_t mod_sub(const Modulus *m, uint64_t a, uint64_t b){
+	return a >= b ? a - b : a + (m->n - b);
+}
+
+// a*b*2^-64*2^128*2^-64 for odd moduli
+static uint64_t mod_mul(const Modulus *m, uint64_t a, uint64_t b){
+	if (m->odd) return montgomery_mul(&m->mont, montgomery_mul(&m->mont, a, b), m->mont.r2);
+	return (uint64_t)((uint128_t)a * b % m->n);
+}
+
+static uint64_t mod_pow(const Modulus *m, uint64_t a, uint64_t e){
+	if (m->odd){
+		uint64_t x = montgomery_pow(&m->mont, montgomery_from(&m->mont, a), e);
+		return montgomery_reduce(&m->mont, x);
+	}
+	uint64_t res = 1 % m->n;
+	while (e != 0){
+		if (e & 1) res = (uint64_t)((uint128_t)res * a % m->n);
+		a = (uint64_t)((uint128_t)a * a % m->n);
+		e >>= 1;
+	}
+	return res;
+}
+
+// extended Euclid, false when a and n are not coprime
+static bool mod_inverse(const Modulus *m, uint64_t a, uint64_t *res){
+	__int128 r0 = m->n, r1 = a;
+	__int128 t0 = 0, t1 = 1;
+	while (r1 != 0){
+		__int128 q = r0 / r1;
+		__int128 r = r0 - q*r1;
+		r0 = r1;
+		r1 = r;
+		__int128 t = t0 - q*t1;
+		t0 = t1;
+		t1 = t;
+	}
+	if (r0 != 1) return false;
+	*res = (uint64_t)(t0 < 0 ? t0 + m->n : t0);
+	return true;
+}
+
+
+#define FACTORIAL_CHUNK (1 << 22)
+#define FACTORIAL_LANES 4
+
+typedef struct Factorial{
+	const Modulus *modulus;
+	uint64_t n;
+	uint64_t *products;
+} Factorial;
+
+// Multiplying a plain number into a Montgomery product divides by 2^64 each
+// time, so a run of k numbers is off by 2^-64k and gets one correction at the
+// end instead of converting every number. Independent lanes keep several
+// multiplications in flight.
+static void factorial_chunk(size_t index, void *data){
+	Factorial *f = data;
+	const Modulus *m = f->modulus;
+	uint64_t first = (uint64_t)index * FACTORIAL_CHUNK + 1;
+	uint64_t end = first + FACTORIAL_CHUNK <= f->n ? first + FACTORIAL_CHUNK : f->n + 1;
+
+	uint64_t lanes[FACTORIAL_LANES];
+	for (size_t l=0; l!=FACTORIAL_LANES; l+=1) lanes[l] = 1 % m->n;
+	uint64_t i = first;
+	if (m->odd){
+		for (; i+FACTORIAL_LANES<=end; i+=FACTORIAL_LANES){
+			for (size_t l=0; l!=FACTORIAL_LANES; l+=1) lanes[l] = montgomery_mul(&m->mont, lanes[l], i+l);
+		}
+		uint64_t scale = montgomery_pow(&m->mont, m->mont.r2, (i - first) / FACTORIAL_LANES);
+		for (size_t l=0; l!=FACTORIAL_LANES; l+=1) lanes[l] = montgomery_mul(&m->mont, lanes[l], scale);
+	} else{
+		for (; i+FACTORIAL_LANES<=end; i+=FACTORIAL_LANES){
+			for (size_t l=0; l!=FACTORIAL_LANES; l+=1) lanes[l] = (uint64_t)((uint128_t)lanes[l] * (i+l) % m->n);
+		}
+	}
+	uint64_t res = 1 % m->n;
+	for (; i!=end; i+=1) res = mod_mul(m, res, i % m->n);
+	for (size_t l=0; l!=FACTORIAL_LANES; l+=1) res = mod_mul(m, res, lanes[l]);
+	f->products[index] = res;
+}
+
+// n! mod m, zero as soon as m itself is one of the factors
+static uint64_t mod_factorial(const Modulus *m, uint64_t n){
+	if (n >= m->n) return 0;
+	size_t chunk_count = n / FACTORIAL_CHUNK + 1;
+	Factorial f = {.modulus = m, .n = n, .products = malloc(chunk_count * sizeof(uint64_t))};
+	if (f.products == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	parallel_for(chunk_count, factorial_chunk, &f);
+	uint64_t res = 1 % m->n;
+	for (size_t i=0; i!=chunk_count; i+=1) res = mod_mul(m, res, f.products[i]);
+	free(f.products);
+	return res;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "utils.h"
+
+// Runs task(0..count-1) on up to parallel_threads threads, the calling thread
+// included. Indices are handed out one at a time, which keeps uneven tasks
+// balanced. Which thread runs a task is not fixed, so anything that has to be
+// reproducible should be combined by task index afterwards. The other threads
+// are a pool that is started by the first call and sleeps between calls, a
+// call from inside a task runs its tasks on its own thread.
+
+#define PARALLEL_MAX_THREADS 256
+
+static size_t parallel_threads = 1;
+
+typedef struct ParallelJob{
+	void (*task)(size_t index, void *data);
+	void *data;
+	size_t count;
+	atomic_size_t next;
+} ParallelJob;
+
+// workers from 0 to wanted-1 take part in the job of the current generation,
+// the caller waits until active drops to zero, a worker started for a job
+// begins from the generation before it
+typedef struct ParallelPool{
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	size_t started;
+	size_t wanted;
+	size_t active;
+	uint64_t generation;
+	ParallelJob *job;
+	bool fork_handled;
+} ParallelPool;
+
+static ParallelPool parallel_pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+static _Thread_local bool parallel_inside;
+
+static void parallel_run(ParallelJob *job){
+	parallel_inside = true;
+	for (;;){
+		size_t index = atomic_fetch_add(&job->next, 1);
+		if (index >= job->count) break;
+		job->task(index, job->data);
+	}
+	parallel_inside = false;
+}
+
+static void *parallel_worker(void *arg){
+	size_t id = (size_t)(uintptr_t)arg;
+	ParallelPool *pool = &parallel_pool;
+	pthread_mutex_lock(&pool->lock);
+	uint64_t seen = pool->generation - 1;
+	for (;;){
+		while (pool->generation == seen) pthread_cond_wait(&pool->wake, &pool->lock);
+		seen = pool->generation;
+		if (id >= pool->wanted) continue;
+		ParallelJob *job = pool->job;
+		pthread_mutex_unlock(&pool->lock);
+		parallel_run(job);
+		pthread_mutex_lock(&pool->lock);
+		pool->active -= 1;
+		if (pool->active == 0) pthread_cond_signal(&pool->done);
+	}
+	return NULL;
+}
+
+// a forked child has none of the threads, it starts its own pool
+static void parallel_after_fork(void){
+	parallel_pool = (ParallelPool){
+		.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER,
+		.fork_handled = true,
+	};
+}
+
+static void parallel_for(size_t count, void (*task)(size_t index, void *data), void *data){
+	ParallelJob job = {.task = task, .data = data, .count = count};
+	atomic_init(&job.next, 0);
+	size_t helpers = (parallel_threads < count ? parallel_threads : count);
+	helpers = helpers != 0 ? helpers - 1 : 0;
+	if (parallel_inside || helpers == 0){
+		for (size_t i=0; i!=count; i+=1) task(i, data);
+		return;
+	}
+
+	ParallelPool *pool = &parallel_pool;
+	pthread_mutex_lock(&pool->lock);
+	if (!pool->fork_handled) pthread_atfork(NULL, NULL, parallel_after_fork);
+	pool->fork_handled = true;
+	while (pool->started < helpers){
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, parallel_worker, (void *)(uintptr_t)pool->started) != 0) break;
+		pthread_detach(thread);
+		pool->started += 1;
+	}
+	pool->wanted = helpers < pool->started ? helpers : pool->started;
+	pool->active = pool->wanted;
+	pool->job = &job;
+	pool->generation += 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	parallel_run(&job);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active != 0) pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
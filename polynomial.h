@@ -0,0 +1,320 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "utils.h"
+#include "fft.h"
+
+// Polynomials with real coefficients, lowest power first. Products use the
+// schoolbook method for short operands, Karatsuba for medium ones and an FFT
+// beyond that. Long divisions multiply by a power series inverse from Newton's
+// iteration and points are evaluated through a subproduct tree, so the heavy
+// operations all run at the speed of multiplication.
+
+#define POLY_KARATSUBA_THRESHOLD 32
+#define POLY_FFT_THRESHOLD 256
+#define POLY_NEWTON_THRESHOLD 512
+#define POLY_EVAL_LEAF 64
+#define POLY_EVAL_TREE_MIN 1024
+#define POLY_EVAL_CHECKS 16
+
+static double *poly_alloc(size_t size){
+	double *res = malloc((size ? size : 1) * sizeof(double));
+	if (res == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	return res;
+}
+
+static size_t poly_trim(const double *p, size_t size){
+	while (size != 0 && p[size-1] == 0.0) size -= 1;
+	return size;
+}
+
+static void poly_mul_school(double *res, const double *a, size_t a_size, const double *b, size_t b_size){
+	memset(res, 0, (a_size + b_size - 1) * sizeof(double));
+	for (size_t i=0; i!=a_size; i+=1){
+		for (size_t j=0; j!=b_size; j+=1) res[i+j] += a[i]*b[j];
+	}
+}
+
+// (a + b*i)^2 has 2*a*b as its imaginary part, so one forward and one
+// inverse transform are enough. Both operands are scaled by powers of two to
+// a largest coefficient below 1 first, which is exact and keeps the squares
+// of the transform from overflowing, and the product is scaled back at the end
+static void poly_mul_fft(double *res, const double *a, size_t a_size, const double *b, size_t b_size){
+	size_t size = a_size + b_size - 1;
+	size_t n = 1;
+	while (n < size) n *= 2;
+	double a_max = 0.0, b_max = 0.0;
+	for (size_t i=0; i!=a_size; i+=1) a_max = fmax(a_max, fabs(a[i]));
+	for (size_t i=0; i!=b_size; i+=1) b_max = fmax(b_max, fabs(b[i]));
+	if (a_max == 0.0 || b_max == 0.0){
+		memset(res, 0, size * sizeof(double));
+		return;
+	}
+	int a_exp, b_exp;
+	frexp(a_max, &a_exp);
+	frexp(b_max, &b_exp);
+	double *re = calloc(2*n, sizeof(double));
+	if (re == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	double *im = re + n;
+	for (size_t i=0; i!=a_size; i+=1) re[i] = ldexp(a[i], -a_exp);
+	for (size_t i=0; i!=b_size; i+=1) im[i] = ldexp(b[i], -b_exp);
+	fft(re, im, n, false);
+	for (size_t i=0; i!=n; i+=1){
+		double r = re[i], m = im[i];
+		re[i] = r*r - m*m;
+		im[i] = 2.0*r*m;
+	}
+	fft(re, im, n, true);
+	for (size_t i=0; i!=size; i+=1) res[i] = ldexp(im[i] / (2.0 * (double)n), a_exp + b_exp);
+	free(re);
+}
+
+static void poly_mul_karatsuba(double *res, const double *a, size_t a_size, const double *b, size_t b_size);
+
+// res[0, a_size+b_size-1) = a*b, res must not overlap the operands
+static void poly_mul(double *res, const double *a, size_t a_size, const double *b, size_t b_size){
+	if (a_size < b_size){
+		const double *t = a;
+		a = b;
+		b = t;
+		size_t s = a_size;
+		a_size = b_size;
+		b_size = s;
+	}
+	if (b_size < POLY_KARATSUBA_THRESHOLD) poly_mul_school(res, a, a_size, b, b_size);
+	else if (b_size < POLY_FFT_THRESHOLD) poly_mul_karatsuba(res, a, a_size, b, b_size);
+	else poly_mul_fft(res, a, a_size, b, b_size);
+}
+
+// a_size >= b_size, operands of very different sizes are cut into pieces the
+// size of the shorter one
+static void poly_mul_karatsuba(double *res, const double *a, size_t a_size, const double *b, size_t b_size){
+	size_t size = a_size + b_size - 1;
+	if (a_size >= 2*b_size){
+		memset(res, 0, size * sizeof(double));
+		double *part = poly_alloc(2*b_size - 1);
+		for (size_t offset=0; offset<a_size; offset+=b_size){
+			size_t part_size = a_size - offset < b_size ? a_size - offset : b_size;
+			poly_mul(part, a + offset, part_size, b, b_size);
+			for (size_t i=0; i!=part_size + b_size - 1; i+=1) res[offset + i] += part[i];
+		}
+		free(part);
+		return;
+	}
+
+	size_t half = b_size / 2;
+	size_t a1_size = a_size - half;
+	size_t b1_size = b_size - half;
+	poly_mul(res, a, half, b, half);
+	res[2*half - 1] = 0.0;
+	poly_mul(res + 2*half, a + half, a1_size, b + half, b1_size);
+
+	double *sa = poly_alloc(a1_size + b1_size);
+	double *sb = sa + a1_size;
+	for (size_t i=0; i!=a1_size; i+=1) sa[i] = a[half + i] + (i < half ? a[i] : 0.0);
+	for (size_t i=0; i!=b1_size; i+=1) sb[i] = b[half + i] + (i < half ? b[i] : 0.0);
+	size_t middle_size = a1_size + b1_size - 1;
+	double *middle = poly_alloc(middle_size);
+	poly_mul(middle, sa, a1_size, sb, b1_size);
+	for (size_t i=0; i!=2*half - 1; i+=1) middle[i] -= res[i];
+	for (size_t i=0; i!=middle_size; i+=1) middle[i] -= res[2*half + i];
+	for (size_t i=0; i!=middle_size; i+=1) res[half + i] += middle[i];
+	free(middle);
+	free(sa);
+}
+
+// first n coefficients of 1/b with Newton's iteration g = g*(2 - b*g), which
+// doubles the number of correct coefficients every step, b[0] must not be 0
+static double *poly_inverse_series(const double *b, size_t b_size, size_t n){
+	double *g = poly_alloc(n);
+	double *t = poly_alloc(3*n);
+	double *u = poly_alloc(n);
+	g[0] = 1.0 / b[0];
+	for (size_t len=1; len<n;){
+		size_t next = 2*len < n ? 2*len : n;
+		size_t bl = b_size < next ? b_size : next;
+		poly_mul(t, b, bl, g, len);
+		for (size_t i=0; i!=next; i+=1) u[i] = i < bl+len-1 ? -t[i] : 0.0;
+		u[0] += 2.0;
+		poly_mul(t, g, len, u, next);
+		memcpy(g, t, next * sizeof(double));
+		len = next;
+	}
+	free(u);
+	free(t);
+	return g;
+}
+
+// a = q*b + r with q of a_size-b_size+1 and r of b_size-1 coefficients,
+// a_size >= b_size and the leading coefficient of b must not be 0. Long
+// quotients come from the reversed polynomials, where dividing is
+// multiplying by an inverse series.
+static void poly_divmod(const double *a, size_t a_size, const double *b, size_t b_size, double *q, double *r){
+	size_t q_size = a_size - b_size + 1;
+	if (q_size < POLY_NEWTON_THRESHOLD || b_size < POLY_NEWTON_THRESHOLD){
+		double *rem = poly_alloc(a_size);
+		memcpy(rem, a, a_size * sizeof(double));
+		for (size_t i=q_size; i!=0; i-=1){
+			double c = rem[i-1 + b_size-1] / b[b_size-1];
+			q[i-1] = c;
+			for (size_t j=0; j!=b_size; j+=1) rem[i-1 + j] -= c*b[j];
+		}
+		memcpy(r, rem, (b_size-1) * sizeof(double));
+		free(rem);
+		return;
+	}
+	size_t rb_size = b_size < q_size ? b_size : q_size;
+	double *ra = poly_alloc(q_size + rb_size);
+	double *rb = ra + q_size;
+	for (size_t i=0; i!=q_size; i+=1) ra[i] = a[a_size-1 - i];
+	for (size_t i=0; i!=rb_size; i+=1) rb[i] = b[b_size-1 - i];
+	double *inverse = poly_inverse_series(rb, rb_size, q_size);
+	double *t = poly_alloc(a_size + q_size);
+	poly_mul(t, ra, q_size, inverse, q_size);
+	for (size_t i=0; i!=q_size; i+=1) q[i] = t[q_size-1 - i];
+	poly_mul(t, b, b_size, q, q_size);
+	for (size_t i=0; i!=b_size-1; i+=1) r[i] = a[i] - t[i];
+	free(t);
+	free(inverse);
+	free(ra);
+}
+
+// Euclid's algorithm, remainder coefficients below a tolerance relative to the
+// inputs count as zero. The monic gcd goes to res, which needs room for the
+// longer input, and its size is returned.
+static size_t poly_gcd(const double *a, size_t a_size, const double *b, size_t b_size, double *res){
+	size_t capacity = a_size > b_size ? a_size : b_size;
+	double tolerance = 0.0;
+	for (size_t i=0; i!=a_size; i+=1) tolerance = fmax(tolerance, fabs(a[i]));
+	for (size_t i=0; i!=b_size; i+=1) tolerance = fmax(tolerance, fabs(b[i]));
+	tolerance *= 1e-9;
+
+	double *buffer = poly_alloc(3*capacity);
+	double *u = buffer;
+	double *v = u + capacity;
+	double *w = v + capacity;
+	memcpy(u, a, a_size * sizeof(double));
+	memcpy(v, b, b_size * sizeof(double));
+	size_t u_size = a_size, v_size = b_size;
+	double *q = poly_alloc(capacity);
+	while (v_size != 0){
+		if (u_size >= v_size){
+			poly_divmod(u, u_size, v, v_size, q, w);
+			u_size = v_size - 1;
+			while (u_size != 0 && fabs(w[u_size-1]) <= tolerance) u_size -= 1;
+		} else{
+			memcpy(w, u, u_size * sizeof(double));
+		}
+		double *t = u;
+		u = v;
+		v = w;
+		w = t;
+		size_t s = u_size;
+		u_size = v_size;
+		v_size = s;
+	}
+	for (size_t i=0; i!=u_size; i+=1) res[i] = u[i] / u[u_size-1];
+	free(q);
+	free(buffer);
+	return u_size;
+}
+
+static double poly_horner(const double *p, size_t size, double x){
+	double res = 0.0;
+	for (size_t i=size; i!=0; i-=1) res = res*x + p[i-1];
+	return res;
+}
+
+// the product of x - x_i over the points under a node
+typedef struct SubproductNode{
+	double *poly;
+	size_t size;
+	size_t count;
+	struct SubproductNode *low;
+	struct SubproductNode *high;
+} SubproductNode;
+
+static SubproductNode *subproduct_tree(const double *xs, size_t count){
+	SubproductNode *node = malloc(sizeof(SubproductNode));
+	if (node == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	node->count = count;
+	node->size = count + 1;
+	node->poly = poly_alloc(count + 1);
+	if (count <= POLY_EVAL_LEAF){
+		node->low = node->high = NULL;
+		node->poly[0] = 1.0;
+		for (size_t i=0; i!=count; i+=1){
+			node->poly[i+1] = 0.0;
+			for (size_t j=i+1; j!=0; j-=1) node->poly[j] = node->poly[j-1] - xs[i]*node->poly[j];
+			node->poly[0] *= -xs[i];
+		}
+		return node;
+	}
+	node->low = subproduct_tree(xs, count/2);
+	node->high = subproduct_tree(xs + count/2, count - count/2);
+	poly_mul(node->poly, node->low->poly, node->low->size, node->high->poly, node->high->size);
+	return node;
+}
+
+static void subproduct_free(SubproductNode *node){
+	if (node == NULL) return;
+	subproduct_free(node->low);
+	subproduct_free(node->high);
+	free(node->poly);
+	free(node);
+}
+
+// p mod the node polynomial has the same values at the points of the node
+static void subproduct_eval(const SubproductNode *node, const double *p, size_t p_size, const double *xs, double *res){
+	double *rem = NULL;
+	if (p_size >= node->size){
+		double *q = poly_alloc(p_size - node->size + 1);
+		rem = poly_alloc(node->size - 1);
+		poly_divmod(p, p_size, node->poly, node->size, q, rem);
+		free(q);
+		p = rem;
+		p_size = node->size - 1;
+	}
+	if (node->low == NULL){
+		for (size_t i=0; i!=node->count; i+=1) res[i] = poly_horner(p, p_size, xs[i]);
+	} else{
+		subproduct_eval(node->low, p, p_size, xs, res);
+		subproduct_eval(node->high, p, p_size, xs + node->low->count, res + node->low->count);
+	}
+	free(rem);
+}
+
+// Horner's rule unless both the polynomial and the point set are large. The
+// coefficients of the products grow exponentially with the number of points,
+// so in doubles the tree only holds up for some point sets. A few points are
+// checked against Horner's rule and all of them go through it if one is off.
+static void poly_eval_points(const double *p, size_t p_size, const double *xs, size_t count, double *res){
+	if (p_size >= POLY_EVAL_TREE_MIN && count >= POLY_EVAL_TREE_MIN){
+		SubproductNode *tree = subproduct_tree(xs, count);
+		subproduct_eval(tree, p, p_size, xs, res);
+		subproduct_free(tree);
+		double scale = 0.0;
+		for (size_t i=0; i!=p_size; i+=1) scale += fabs(p[i]);
+		bool accurate = true;
+		for (size_t i=0; i!=POLY_EVAL_CHECKS && accurate; i+=1){
+			size_t k = i * (count-1) / (POLY_EVAL_CHECKS-1);
+			double expected = poly_horner(p, p_size, xs[k]);
+			double bound = 1e-9 * fmax(fabs(expected), scale);
+			accurate = fabs(res[k] - expected) <= bound;
+		}
+		if (accurate) return;
+	}
+	for (size_t i=0; i!=count; i+=1) res[i] = poly_horner(p, p_size, xs[i]);
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include "utils.h"
+#include "parallel.h"
+
+// Primality, factoring and prime counting on 64 bit integers.
+
+typedef unsigned __int128 uint128_t;
+
+// Montgomery form modulo an odd n, a number a is kept as a*2^64 mod n so that
+// a product needs two multiplications and no division
+typedef struct Montgomery{
+	uint64_t n;
+	uint64_t inv;
+	uint64_t one;
+	uint64_t r2;
+} Montgomery;
+
+static Montgomery montgomery_init(uint64_t n){
+	uint64_t inv = n;
+	for (int i=0; i!=5; i+=1) inv *= 2 - n*inv;
+	uint64_t one = (0 - n) % n;
+	return (Montgomery){n, inv, one, (uint64_t)((uint128_t)one * one % n)};
+}
+
+// t/2^64 mod n for t < n*2^64, the low halves of t and q*n are equal
+static uint64_t montgomery_reduce(const Montgomery *m, uint128_t t){
+	uint64_t q = (uint64_t)t * m->inv;
+	uint64_t h = (uint64_t)(((uint128_t)q * m->n) >> 64);
+	uint64_t hi = (uint64_t)(t >> 64);
+	return hi >= h ? hi - h : hi - h + m->n;
+}
+
+static uint64_t montgomery_mul(const Montgomery *m, uint64_t a, uint64_t b){
+	return montgomery_reduce(m, (uint128_t)a * b);
+}
+
+static uint64_t montgomery_from(const Montgomery *m, uint64_t a){
+	return montgomery_mul(m, a % m->n, m->r2);
+}
+
+static uint64_t montgomery_add(const Montgomery *m, uint64_t a, uint64_t b){
+	return a >= m->n - b ? a - (m->n - b) : a + b;
+}
+
+static uint64_t montgomery_pow(const Montgomery *m, uint64_t a, uint64_t e){
+	uint64_t res = m->one;
+	while (e != 0){
+		if (e & 1) res = montgomery_mul(m, res, a);
+		a = montgomery_mul(m, a, a);
+		e >>= 1;
+	}
+	return res;
+}
+
+static uint64_t gcd_u64(uint64_t a, uint64_t b){
+	if (a == 0) return b;
+	if (b == 0) return a;
+	int shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	while (b != 0){
+		b >>= __builtin_ctzll(b);
+		if (a > b){
+			uint64_t t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	}
+	return a << shift;
+}
+
+static const uint8_t small_primes[] = {
+	2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97
+};
+
+// Miller-Rabin with a base set that has no strong pseudoprimes below 2^64
+static bool is_prime_u64(uint64_t n){
+	for (size_t i=0; i!=SIZE(small_primes); i+=1){
+		if (n == small_primes[i]) return true;
+		if (n % small_primes[i] == 0) return false;
+	}
+	if (n < 100*100) return n >= 2;
+
+	static const uint64_t bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+	Montgomery m = montgomery_init(n);
+	uint64_t d = n - 1;
+	int s = __builtin_ctzll(d);
+	d >>= s;
+	uint64_t minus_one = n - m.one;
+	for (size_t i=0; i!=SIZE(bases); i+=1){
+		uint64_t a = bases[i] % n;
+		if (a == 0) continue;
+		uint64_t x = montgomery_pow(&m, montgomery_from(&m, a), d);
+		if (x == m.one || x == minus_one) continue;
+		bool composite = true;
+		for (int r=1; r<s && composite; r+=1){
+			x = montgomery_mul(&m, x, x);
+			if (x == minus_one) composite = false;
+		}
+		if (composite) return false;
+	}
+	return true;
+}
+
+#define RHO_BATCH 128
+
+// Brent's variant of Pollard's rho, n has to be odd and composite. Differences
+// are multiplied together and only every RHO_BATCH steps go through a gcd.
+static uint64_t pollard_brent(uint64_t n){
+	Montgomery m = montgomery_init(n);
+	for (uint64_t c=1;; c+=1){
+		uint64_t mc = montgomery_from(&m, c);
+		uint64_t y = montgomery_from(&m, 2);
+		uint64_t x = y;
+		uint64_t ys = y;
+		uint64_t q = m.one;
+		uint64_t g = 1;
+		for (uint64_t r=1; g==1; r*=2){
+			x = y;
+			for (uint64_t i=0; i!=r; i+=1) y = montgomery_add(&m, montgomery_mul(&m, y, y), mc);
+			for (uint64_t k=0; k<r && g==1; k+=RHO_BATCH){
+				ys = y;
+				for (uint64_t i=0; i<RHO_BATCH && i<r-k; i+=1){
+					y = montgomery_add(&m, montgomery_mul(&m, y, y), mc);
+					q = montgomery_mul(&m, q, x > y ? x - y : y - x);
+				}
+				g = gcd_u64(q, n);
+			}
+		}
+		// the batch overshot, step again one difference at a time
+		if (g == n){
+			do{
+				ys = montgomery_add(&m, montgomery_mul(&m, ys, ys), mc);
+				g = gcd_u64(x > ys ? x - ys : ys - x, n);
+			} while (g == 1);
+		}
+		if (g != n) return g;
+	}
+}
+
+static int compare_u64(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// prime factors of n with multiplicity in ascending order, at most 64 of them
+static size_t factor_u64(uint64_t n, uint64_t *factors){
+	size_t count = 0;
+	for (size_t i=0; i!=SIZE(small_primes) && n!=1; i+=1){
+		while (n % small_primes[i] == 0){
+			factors[count++] = small_primes[i];
+			n /= small_primes[i];
+		}
+	}
+	uint64_t pending[64];
+	size_t pending_count = 0;
+	if (n != 1) pending[pending_count++] = n;
+	while (pending_count != 0){
+		uint64_t f = pending[--pending_count];
+		if (is_prime_u64(f)){
+			factors[count++] = f;
+			continue;
+		}
+		uint64_t d = pollard_brent(f);
+		pending[pending_count++] = d;
+		pending[pending_count++] = f / d;
+	}
+	qsort(factors, count, sizeof(uint64_t), compare_u64);
+	return count;
+}
+
+
+// Segments are sieved over odd numbers only, one byte each, and are sized to
+// stay in the L1 cache. A task sieves a run of consecutive segments, so the
+// next multiple of every prime carries over from one segment to the next and
+// only has to be found with a division once per task. Multiples of the primes
+// up to 13 repeat every 15015 odd numbers, so segments start as a copy of that
+// pattern instead of being sieved by them.
+#define SIEVE_SEGMENT 32768
+#define SIEVE_TASK_SEGMENTS 64
+#define SIEVE_TASK_SPAN (2 * (uint64_t)SIEVE_SEGMENT * SIEVE_TASK_SEGMENTS)
+#define SIEVE_PATTERN (3*5*7*11*13)
+#define SIEVE_PRESIEVED 5
+
+typedef struct Sieve{
+	uint64_t limit;
+	uint32_t *primes;
+	size_t prime_count;
+	uint64_t *counts;
+	uint8_t pattern[SIEVE_PATTERN + SIEVE_SEGMENT];
+} Sieve;
+
+// bytes are 0 or 1, so 255 words can be added before a byte overflows
+static uint64_t count_marked(const uint8_t *bytes, size_t size){
+	uint64_t res = 0;
+	size_t i = 0;
+	while (i+8 <= size){
+		uint64_t acc = 0;
+		for (size_t k=0; k!=255 && i+8<=size; k+=1, i+=8){
+			uint64_t word;
+			memcpy(&word, bytes + i, 8);
+			acc += word;
+		}
+		acc = (acc & 0x00FF00FF00FF00FFull) + ((acc >> 8) & 0x00FF00FF00FF00FFull);
+		res += (acc * 0x0001000100010001ull) >> 48;
+	}
+	for (; i!=size; i+=1) res += bytes[i];
+	return res;
+}
+
+// odd primes up to limit with a plain sieve, limit is at most 2^32
+static uint32_t *small_sieve(uint64_t limit, size_t *count){
+	uint8_t *composite = calloc(limit + 1, 1);
+	uint32_t *primes = malloc((limit/2 + 1) * sizeof(uint32_t));
+	if (composite == NULL || primes == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	*count = 0;
+	for (uint64_t i=3; i<=limit; i+=2){
+		if (composite[i]) continue;
+		primes[(*count)++] = i;
+		for (uint64_t j=i*i; j<=limit; j+=2*i) composite[j] = 1;
+	}
+	free(composite);
+	return primes;
+}
+
+static void sieve_task(size_t index, void *data){
+	Sieve *sieve = data;
+	uint64_t low = index * SIEVE_TASK_SPAN;
+	uint64_t high = low + SIEVE_TASK_SPAN;
+	if (high > sieve->limit + 1) high = sieve->limit + 1;
+
+	// offsets count odd numbers from the start of the current segment
+	size_t prime_count = SIEVE_PRESIEVED;
+	while (prime_count != sieve->prime_count && (uint64_t)sieve->primes[prime_count]*sieve->primes[prime_count] < high)
+		prime_count += 1;
+	uint64_t *offsets = malloc((prime_count + 1) * sizeof(uint64_t));
+	if (offsets == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	for (size_t i=SIEVE_PRESIEVED; i<prime_count; i+=1){
+		uint64_t p = sieve->primes[i];
+		uint64_t start = p*p > low ? p*p : (low + p-1) / p * p;
+		if (start % 2 == 0) start += p;
+		offsets[i] = (start - low) / 2;
+	}
+
+	// byte i of a segment stands for segment_low + 2*i + 1
+	uint8_t segment[SIEVE_SEGMENT];
+	uint64_t count = 0;
+	for (uint64_t segment_low=low; segment_low<high; segment_low+=2*SIEVE_SEGMENT){
+		memcpy(segment, sieve->pattern + segment_low/2 % SIEVE_PATTERN, SIEVE_SEGMENT);
+		if (segment_low == 0){
+			// the pattern marks the presieved primes themselves
+			segment[0] = 1;
+			for (size_t i=0; i!=SIEVE_PRESIEVED; i+=1) segment[(sieve->primes[i] - 1) / 2] = 0;
+		}
+		for (size_t i=SIEVE_PRESIEVED; i<prime_count; i+=1){
+			uint64_t p = sieve->primes[i];
+			uint64_t j = offsets[i];
+			for (; j<SIEVE_SEGMENT; j+=p) segment[j] = 1;
+			offsets[i] = j - SIEVE_SEGMENT;
+		}
+		uint64_t odd_count = (high - segment_low) / 2;
+		if (odd_count > SIEVE_SEGMENT) odd_count = SIEVE_SEGMENT;
+		count += odd_count - count_marked(segment, odd_count);
+	}
+	sieve->counts[index] = count;
+	free(offsets);
+}
+
+// number of primes up to limit
+static uint64_t prime_count_u64(uint64_t limit){
+	if (limit < 2) return 0;
+	Sieve *sieve = malloc(sizeof(Sieve));
+	if (sieve == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	sieve->limit = limit;
+	uint64_t root = (uint64_t)sqrtl((long double)limit) + 1;
+	if (root < 13) root = 13;
+	sieve->primes = small_sieve(root, &sieve->prime_count);
+	memset(sieve->pattern, 0, sizeof(sieve->pattern));
+	for (size_t i=0; i!=SIEVE_PRESIEVED; i+=1){
+		for (size_t j=(sieve->primes[i]-1)/2; j<sizeof(sieve->pattern); j+=sieve->primes[i]) sieve->pattern[j] = 1;
+	}
+	size_t task_count = limit / SIEVE_TASK_SPAN + 1;
+	sieve->counts = malloc(task_count * sizeof(uint64_t));
+	if (sieve->counts == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	parallel_for(task_count, sieve_task, sieve);
+	uint64_t res = 1;
+	for (size_t i=0; i!=task_count; i+=1) res += sieve->counts[i];
+	free(sieve->primes);
+	free(sieve->counts);
+	free(sieve);
+	return res;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <math.h>
+
+#include "utils.h"
+
+// Philox4x32-10 counter based generator. The n-th number of a stream is a pure
+// function of (seed, stream, n), so any part of any stream can be produced
+// independently, in any order and on any thread.
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+#define RANDOM_LANES 8
+#define RANDOM_BUFFER 64
+
+// all lanes run the same rounds on separate counters, which the compiler
+// turns into vector multiplies
+static void philox_lanes(uint32_t ctr[4][RANDOM_LANES], uint64_t seed){
+	uint32_t k0 = (uint32_t)seed;
+	uint32_t k1 = (uint32_t)(seed >> 32);
+	for (int round=0; round!=10; round+=1){
+		for (int i=0; i!=RANDOM_LANES; i+=1){
+			uint64_t p0 = (uint64_t)PHILOX_M0 * ctr[0][i];
+			uint64_t p1 = (uint64_t)PHILOX_M1 * ctr[2][i];
+			uint32_t c1 = ctr[1][i];
+			uint32_t c3 = ctr[3][i];
+			ctr[0][i] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+			ctr[1][i] = (uint32_t)p1;
+			ctr[2][i] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+			ctr[3][i] = (uint32_t)p0;
+		}
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+}
+
+static double bits_to_unit(uint32_t hi, uint32_t lo){
+	return (double)((((uint64_t)hi << 32) | lo) >> 11) * 0x1.0p-53;
+}
+
+// numbers first..first+size of a stream, uniform on [0, 1)
+static void random_fill(uint64_t seed, uint64_t stream, uint64_t first, double *out, size_t size){
+	uint64_t block = first / 2;
+	size_t skip = first % 2;
+	size_t done = 0;
+	while (done != size){
+		uint32_t ctr[4][RANDOM_LANES];
+		for (int i=0; i!=RANDOM_LANES; i+=1){
+			ctr[0][i] = (uint32_t)(block + i);
+			ctr[1][i] = (uint32_t)((block + i) >> 32);
+			ctr[2][i] = (uint32_t)stream;
+			ctr[3][i] = (uint32_t)(stream >> 32);
+		}
+		philox_lanes(ctr, seed);
+		double lanes[2*RANDOM_LANES];
+		for (int i=0; i!=RANDOM_LANES; i+=1){
+			lanes[2*i]   = bits_to_unit(ctr[0][i], ctr[1][i]);
+			lanes[2*i+1] = bits_to_unit(ctr[2][i], ctr[3][i]);
+		}
+		for (size_t i=skip; i!=2*RANDOM_LANES && done!=size; i+=1){
+			out[done] = lanes[i];
+			done += 1;
+		}
+		skip = 0;
+		block += RANDOM_LANES;
+	}
+}
+
+// Box-Muller on consecutive pairs, size has to be even
+static void random_fill_normal(uint64_t seed, uint64_t stream, uint64_t first, double *out, size_t size){
+	random_fill(seed, stream, first, out, size);
+	for (size_t i=0; i<size; i+=2){
+		double r = sqrt(-2.0 * log1p(-out[i]));
+		double t = 2.0 * M_PI * out[i+1];
+		out[i]   = r * cos(t);
+		out[i+1] = r * sin(t);
+	}
+}
+
+
+// floats take a word each, so a block gives twice as many of them, uniform on
+// [0, 1) with 24 random bits
+static void random_fill_single(uint64_t seed, uint64_t stream, uint64_t first, float *out, size_t size){
+	uint64_t block = first / 4;
+	size_t skip = first % 4;
+	size_t done = 0;
+	while (done != size){
+		uint32_t ctr[4][RANDOM_LANES];
+		for (int i=0; i!=RANDOM_LANES; i+=1){
+			ctr[0][i] = (uint32_t)(block + i);
+			ctr[1][i] = (uint32_t)((block + i) >> 32);
+			ctr[2][i] = (uint32_t)stream;
+			ctr[3][i] = (uint32_t)(stream >> 32);
+		}
+		philox_lanes(ctr, seed);
+		float lanes[4*RANDOM_LANES];
+		for (int i=0; i!=RANDOM_LANES; i+=1){
+			for (int w=0; w!=4; w+=1) lanes[4*i + w] = (float)(ctr[w][i] >> 8) * 0x1.0p-24f;
+		}
+		for (size_t i=skip; i!=4*RANDOM_LANES && done!=size; i+=1){
+			out[done] = lanes[i];
+			done += 1;
+		}
+		skip = 0;
+		block += RANDOM_LANES;
+	}
+}
+
+static void random_fill_normal_single(uint64_t seed, uint64_t stream, uint64_t first, float *out, size_t size){
+	random_fill_single(seed, stream, first, out, size);
+	for (size_t i=0; i<size; i+=2){
+		float r = sqrtf(-2.0f * log1pf(-out[i]));
+		float t = 2.0f * (float)M_PI * out[i+1];
+		out[i]   = r * cosf(t);
+		out[i+1] = r * sinf(t);
+	}
+}
+
+// sequential reader of one stream, refilled a batch at a time
+typedef struct Random{
+	uint64_t seed;
+	uint64_t stream;
+	uint64_t next;
+	size_t used;
+	double buffer[RANDOM_BUFFER];
+	bool has_spare;
+	double spare;
+} Random;
+
+static Random random_init(uint64_t seed, uint64_t stream){
+	return (Random){.seed = seed, .stream = stream, .used = RANDOM_BUFFER};
+}
+
+static double random_uniform(Random *r){
+	if (r->used == RANDOM_BUFFER){
+		random_fill(r->seed, r->stream, r->next, r->buffer, RANDOM_BUFFER);
+		r->next += RANDOM_BUFFER;
+		r->used = 0;
+	}
+	r->used += 1;
+	return r->buffer[r->used-1];
+}
+
+static double random_normal(Random *r){
+	if (r->has_spare){
+		r->has_spare = false;
+		return r->spare;
+	}
+	double u0 = random_uniform(r);
+	double u1 = random_uniform(r);
+	double radius = sqrt(-2.0 * log1p(-u0));
+	r->spare = radius * sin(2.0 * M_PI * u1);
+	r->has_spare = true;
+	return radius * cos(2.0 * M_PI * u1);
+}
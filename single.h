@@ -0,0 +1,151 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#include "utils.h"
+
+// Single precision math over arrays of lanes, written on vectors of floats so
+// that every instruction works on twice as many lanes as it would on doubles.
+// Branches are masks, the exponential is a polynomial on a small interval
+// scaled by a power of two, the logarithm a series in the mantissa and the
+// factorial steps its argument down to [1, 2) where a polynomial takes
+// over. Results are good to a few units in the last place, pow loses more when
+// its result is near the ends of the float range. Counts are multiples of
+// SINGLE_VECTOR_LANES.
+
+#define SINGLE_VECTOR_LANES 4
+#define SINGLE_ROUND 12582912.0f
+#define SINGLE_GAMMA_STEPS 34
+#define SINGLE_GAMMA_MAX 35.04f
+
+typedef float SingleVector __attribute__((vector_size(SINGLE_VECTOR_LANES * sizeof(float))));
+typedef int32_t SingleMask __attribute__((vector_size(SINGLE_VECTOR_LANES * sizeof(int32_t))));
+
+static inline bool single_any(SingleMask m){
+	int32_t any = 0;
+	for (size_t l=0; l!=SINGLE_VECTOR_LANES; l+=1) any |= m[l];
+	return any != 0;
+}
+
+static inline SingleVector single_splat(float x){
+	SingleVector v = {0};
+	return v + x;
+}
+
+static inline SingleVector single_select(SingleMask m, SingleVector a, SingleVector b){
+	return (SingleVector)(((SingleMask)a & m) | ((SingleMask)b & ~m));
+}
+
+// e^r * 2^n for |r| <= ln(2)/2, 2^n is applied in two halves so that neither
+// leaves the exponent range
+static inline SingleVector single_scale(SingleVector r, SingleVector n){
+	SingleVector p = 1.0f + r*(1.0f + r*(0.5f + r*(1.6666667e-1f + r*(4.1666668e-2f +
+		r*(8.3333333e-3f + r*(1.3888889e-3f + r*1.9841270e-4f))))));
+	SingleMask k = __builtin_convertvector(n, SingleMask);
+	SingleMask k1 = k >> 1;
+	return p * (SingleVector)((k1 + 127) << 23) * (SingleVector)((k - k1 + 127) << 23);
+}
+
+// n is x/ln(2) rounded, x - n*ln(2) is taken with ln(2) in two parts
+static inline SingleVector single_exp(SingleVector x){
+	SingleVector c = single_select(x > -104.0f, x, single_splat(-104.0f));
+	c = single_select(c < 89.0f, c, single_splat(89.0f));
+	SingleVector n = (c*1.44269504f + SINGLE_ROUND) - SINGLE_ROUND;
+	SingleVector r = (c - n*0.693145751953125f) - n*1.42860677e-6f;
+	return single_select(x != x, x, single_scale(r, n));
+}
+
+static inline SingleVector single_exp2(SingleVector x){
+	SingleVector c = single_select(x > -150.0f, x, single_splat(-150.0f));
+	c = single_select(c < 129.0f, c, single_splat(129.0f));
+	SingleVector n = (c + SINGLE_ROUND) - SINGLE_ROUND;
+	return single_select(x != x, x, single_scale((c - n)*0.693147181f, n));
+}
+
+// x = m*2^e with m in [sqrt(1/2), sqrt(2)), log2(m) from the series of atanh
+static inline SingleVector single_log2(SingleVector x){
+	SingleMask tiny = x < 1.17549435e-38f;
+	SingleMask bits = (SingleMask)single_select(tiny, x*8388608.0f, x);
+	SingleMask e = ((bits >> 23) & 255) - 127 - (tiny & 23);
+	SingleVector m = (SingleVector)((bits & 0x007FFFFF) | 0x3F800000);
+	SingleMask high = m > 1.41421356f;
+	m = single_select(high, m*0.5f, m);
+	e -= high;
+	SingleVector t = (m - 1.0f) / (m + 1.0f);
+	SingleVector t2 = t*t;
+	SingleVector res = __builtin_convertvector(e, SingleVector) +
+		t*(2.88539008f + t2*(0.961796694f + t2*(0.577078016f + t2*(0.412198583f + t2*0.320598898f))));
+	res = single_select(x == 0.0f, single_splat(-INFINITY), res);
+	res = single_select(x < 0.0f, single_splat(NAN), res);
+	return single_select((x == INFINITY) | (x != x), x, res);
+}
+
+static void single_exp_lanes(float *restrict d, const float *a, size_t count){
+	for (size_t i=0; i!=count; i+=SINGLE_VECTOR_LANES){
+		SingleVector x;
+		memcpy(&x, a + i, sizeof(x));
+		x = single_exp(x);
+		memcpy(d + i, &x, sizeof(x));
+	}
+}
+
+static void single_log_lanes(float *restrict d, const float *a, size_t count){
+	for (size_t i=0; i!=count; i+=SINGLE_VECTOR_LANES){
+		SingleVector x;
+		memcpy(&x, a + i, sizeof(x));
+		x = single_log2(x) * 0.693147181f;
+		memcpy(d + i, &x, sizeof(x));
+	}
+}
+
+// a negative base needs an integer exponent, which is odd when the rounded
+// exponent is, exponents from 2^22 on are all even integers
+static void single_pow_lanes(float *restrict d, const float *a, const float *b, size_t count){
+	SingleVector zero = {0};
+	for (size_t i=0; i!=count; i+=SINGLE_VECTOR_LANES){
+		SingleVector x, y;
+		memcpy(&x, a + i, sizeof(x));
+		memcpy(&y, b + i, sizeof(y));
+		SingleVector magnitude = single_select(x < 0.0f, -x, x);
+		SingleVector res = single_exp2(y * single_log2(magnitude));
+		SingleMask small = (y < 4194304.0f) & (y > -4194304.0f);
+		SingleVector rounded = (y + SINGLE_ROUND) - SINGLE_ROUND;
+		SingleMask integer = ~small | (rounded == y);
+		SingleMask odd = small & ((__builtin_convertvector(single_select(small, rounded, zero), SingleMask) & 1) != 0);
+		SingleMask negative = x < 0.0f;
+		res = single_select(negative & odd, -res, res);
+		res = single_select(negative & ~integer, single_splat(NAN), res);
+		res = single_select((y == 0.0f) | (x == 1.0f), single_splat(1.0f), res);
+		memcpy(d + i, &res, sizeof(res));
+	}
+}
+
+// a! = Gamma(x) with x = a+1, Gamma(x) = (x-1)*Gamma(x-1) down to [1, 2),
+// below 1 it is Gamma(x+1)/x, on [1, 2) the polynomial of Abramowitz and
+// Stegun 6.1.36. Arguments of gamma that are not positive go to the library.
+static void single_factorial_lanes(float *restrict d, const float *a, size_t count){
+	SingleVector one = single_splat(1.0f);
+	for (size_t i=0; i!=count; i+=SINGLE_VECTOR_LANES){
+		SingleVector x;
+		memcpy(&x, a + i, sizeof(x));
+		x += 1.0f;
+		SingleMask below = x < 1.0f;
+		SingleVector r = single_select(below, x + 1.0f, x);
+		SingleVector acc = single_select(below, one / x, one);
+		for (int k=0; k!=SINGLE_GAMMA_STEPS; k+=1){
+			SingleMask step = r >= 2.0f;
+			if (!single_any(step)) break;
+			r = single_select(step, r - 1.0f, r);
+			acc = single_select(step, acc*r, acc);
+		}
+		SingleVector t = r - 1.0f;
+		SingleVector p = 1.0f + t*(-0.577191652f + t*(0.988205891f + t*(-0.897056937f + t*(0.918206857f +
+			t*(-0.756704078f + t*(0.482199394f + t*(-0.193527818f + t*0.035868343f)))))));
+		SingleVector res = single_select(x > SINGLE_GAMMA_MAX, single_splat(INFINITY), acc*p);
+		memcpy(d + i, &res, sizeof(res));
+	}
+	for (size_t i=0; i!=count; i+=1){
+		if (!(a[i] + 1.0f > 0.0f)) d[i] = tgammaf(a[i] + 1.0f);
+	}
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "utils.h"
+#include "parallel.h"
+
+// Sorting and selection of doubles through integer keys that order the same
+// way, with every NaN after infinity. Full sorts are LSD radix sorts a byte at
+// a time, where each chunk of the input counts its digits and scatters its
+// keys on its own thread, and a pass is skipped when every key shares its
+// digit. Single order statistics come from introselect: quickselect on a
+// median of three pivot, switching to medians of medians when the partitions
+// stay lopsided, which keeps the worst case linear. Large inputs only select
+// among the keys that a sample puts close to the wanted rank.
+
+#define SORT_BUCKETS 256
+#define SORT_CHUNK (1 << 16)
+#define SORT_SMALL 32
+#define SELECT_SAMPLE_MIN (1 << 20)
+#define SELECT_SAMPLE (1 << 16)
+
+static inline uint64_t sort_key(double x){
+	if (x != x) return UINT64_MAX;
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return bits >> 63 ? ~bits : bits | (1ull << 63);
+}
+
+static inline double sort_value(uint64_t key){
+	uint64_t bits = key >> 63 ? key & ~(1ull << 63) : ~key;
+	double x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+typedef struct SortKeys{
+	const double *x;
+	uint64_t *keys;
+	size_t count;
+} SortKeys;
+
+static void sort_keys_task(size_t index, void *data){
+	const SortKeys *job = data;
+	size_t end = (index + 1) * SORT_CHUNK < job->count ? (index + 1) * SORT_CHUNK : job->count;
+	for (size_t i=index*SORT_CHUNK; i!=end; i+=1) job->keys[i] = sort_key(job->x[i]);
+}
+
+static void sort_keys(uint64_t *keys, const double *x, size_t count){
+	SortKeys job = {x, keys, count};
+	parallel_for((count + SORT_CHUNK-1) / SORT_CHUNK, sort_keys_task, &job);
+}
+
+// one pass moves keys, and their indices when there are any, from src to dst
+// by the byte at shift, counts holds SORT_BUCKETS counters per chunk
+typedef struct RadixPass{
+	const uint64_t *src;
+	uint64_t *dst;
+	const uint32_t *src_index;
+	uint32_t *dst_index;
+	size_t count;
+	unsigned shift;
+	size_t *counts;
+} RadixPass;
+
+static void radix_count_task(size_t index, void *data){
+	const RadixPass *p = data;
+	size_t *counts = p->counts + index * SORT_BUCKETS;
+	memset(counts, 0, SORT_BUCKETS * sizeof(size_t));
+	size_t end = (index + 1) * SORT_CHUNK < p->count ? (index + 1) * SORT_CHUNK : p->count;
+	for (size_t i=index*SORT_CHUNK; i!=end; i+=1) counts[(p->src[i] >> p->shift) & (SORT_BUCKETS-1)] += 1;
+}
+
+static void radix_scatter_task(size_t index, void *data){
+	const RadixPass *p = data;
+	size_t *offsets = p->counts + index * SORT_BUCKETS;
+	size_t end = (index + 1) * SORT_CHUNK < p->count ? (index + 1) * SORT_CHUNK : p->count;
+	for (size_t i=index*SORT_CHUNK; i!=end; i+=1){
+		size_t j = offsets[(p->src[i] >> p->shift) & (SORT_BUCKETS-1)]++;
+		p->dst[j] = p->src[i];
+		if (p->dst_index != NULL) p->dst_index[j] = p->src_index[i];
+	}
+}
+
+static void insertion_sort(uint64_t *keys, uint32_t *indices, size_t count){
+	for (size_t i=1; i<count; i+=1){
+		uint64_t key = keys[i];
+		uint32_t index = indices ? indices[i] : 0;
+		size_t j = i;
+		for (; j!=0 && keys[j-1]>key; j-=1){
+			keys[j] = keys[j-1];
+			if (indices) indices[j] = indices[j-1];
+		}
+		keys[j] = key;
+		if (indices) indices[j] = index;
+	}
+}
+
+// sorts keys in place and carries indices along when they are not NULL, the
+// sort is stable
+static void radix_sort(uint64_t *keys, uint32_t *indices, size_t count){
+	if (count <= SORT_SMALL){
+		insertion_sort(keys, indices, count);
+		return;
+	}
+	size_t chunk_count = (count + SORT_CHUNK-1) / SORT_CHUNK;
+	uint64_t *buffer = malloc(count * sizeof(uint64_t));
+	uint32_t *index_buffer = indices ? malloc(count * sizeof(uint32_t)) : NULL;
+	size_t *counts = malloc(chunk_count * SORT_BUCKETS * sizeof(size_t));
+	if (buffer == NULL || (indices && index_buffer == NULL) || counts == NULL){
+		fprintf(stderr, "ERROR: out of memory\n");
+		exit(1);
+	}
+	RadixPass p = {keys, buffer, indices, index_buffer, count, 0, counts};
+	for (; p.shift!=64; p.shift+=8){
+		parallel_for(chunk_count, radix_count_task, &p);
+		size_t offset = 0;
+		bool trivial = false;
+		for (size_t d=0; d!=SORT_BUCKETS; d+=1){
+			size_t total = 0;
+			for (size_t c=0; c!=chunk_count; c+=1){
+				size_t n = counts[c*SORT_BUCKETS + d];
+				counts[c*SORT_BUCKETS + d] = offset + total;
+				total += n;
+			}
+			if (total == count) trivial = true;
+			offset += total;
+		}
+		if (trivial) continue;
+		parallel_for(chunk_count, radix_scatter_task, &p);
+		const uint64_t *src = p.src;
+		p.src = p.dst;
+		p.dst = (uint64_t *)src;
+		const uint32_t *src_index = p.src_index;
+		p.src_index = p.dst_index;
+		p.dst_index = (uint32_t *)src_index;
+	}
+	if (p.src != keys){
+		memcpy(keys, p.src, count * sizeof(uint64_t));
+		if (indices) memcpy(indices, p.src_index, count * sizeof(uint32_t));
+	}
+	free(counts);
+	free(index_buffer);
+	free(buffer);
+}
+
+static size_t median_of_three(const uint64_t *keys, size_t a, size_t b, size_t c){
+	if (keys[a] > keys[b]){
+		size_t t = a;
+		a = b;
+		b = t;
+	}
+	return keys[c] <= keys[a] ? a : keys[c] >= keys[b] ? b : c;
+}
+
+static void select_key(uint64_t *keys, size_t count, size_t k);
+
+// the index of the median of the medians of groups of five, which are moved
+// to the front
+static size_t median_of_medians(uint64_t *keys, size_t count){
+	size_t group_count = 0;
+	for (size_t i=0; i<count; i+=5){
+		size_t size = count - i < 5 ? count - i : 5;
+		insertion_sort(keys + i, NULL, size);
+		uint64_t t = keys[group_count];
+		keys[group_count] = keys[i + size/2];
+		keys[i + size/2] = t;
+		group_count += 1;
+	}
+	select_key(keys, group_count, group_count / 2);
+	return group_count / 2;
+}
+
+static inline uint64_t select_random(uint64_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// Moves the k-th smallest key to keys[k] with smaller ones before it and
+// larger ones after it. Pivots are medians of three keys at random places,
+// and the Hoare partition stops on keys equal to the pivot from both sides, so
+// repeated keys still split evenly.
+static void select_key(uint64_t *keys, size_t count, size_t k){
+	size_t lo = 0, hi = count;
+	size_t budget = 2 * (64 - __builtin_clzll(count | 1));
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	while (hi - lo > SORT_SMALL){
+		size_t size = hi - lo;
+		size_t at;
+		if (budget != 0){
+			budget -= 1;
+			at = median_of_three(
+				keys, lo + select_random(&state) % size,
+				lo + select_random(&state) % size, lo + select_random(&state) % size
+			);
+		} else{
+			at = lo + median_of_medians(keys + lo, size);
+		}
+		// the pivot goes first, which keeps both sides of the split nonempty
+		uint64_t pivot = keys[at];
+		keys[at] = keys[lo];
+		keys[lo] = pivot;
+		size_t i = lo - 1, j = hi;
+		for (;;){
+			do i += 1; while (keys[i] < pivot);
+			do j -= 1; while (keys[j] > pivot);
+			if (i >= j) break;
+			uint64_t t = keys[i];
+			keys[i] = keys[j];
+			keys[j] = t;
+		}
+		if (k <= j) hi = j + 1;
+		else lo = j + 1;
+	}
+	insertion_sort(keys + lo, NULL, hi - lo);
+}
+
+// counts holds the number of keys under the band [lo, hi] and in it for every
+// chunk, the latter becomes the offset of the chunk in band
+typedef struct SelectBand{
+	const double *x;
+	size_t count;
+	uint64_t lo, hi;
+	size_t *counts;
+	uint64_t *band;
+} SelectBand;
+
+static void select_count_task(size_t index, void *data){
+	SelectBand *b = data;
+	size_t end = (index + 1) * SORT_CHUNK < b->count ? (index + 1) * SORT_CHUNK : b->count;
+	size_t below = 0, inside = 0;
+	for (size_t i=index*SORT_CHUNK; i!=end; i+=1){
+		uint64_t key = sort_key(b->x[i]);
+		below += key < b->lo;
+		inside += key - b->lo <= b->hi - b->lo;
+	}
+	b->counts[2*index] = below;
+	b->counts[2*index + 1] = inside;
+}
+
+static void select_gather_task(size_t index, void *data){
+	SelectBand *b = data;
+	size_t end = (index + 1) * SORT_CHUNK < b->count ? (index + 1) * SORT_CHUNK : b->count;
+	uint64_t *band = b->band + b->counts[2*index + 1];
+	for (size_t i=index*SORT_CHUNK; i!=end; i+=1){
+		uint64_t key = sort_key(b->x[i]);
+		if (key - b->lo <= b->hi - b->lo) *band++ = key;
+	}
+}
+
+// pair gets the k-th smallest key and the one after it, when there is one.
+// Large inputs are sampled first for two keys that most likely enclose both
+// ranks, one pass over all threads then gathers the keys between them and only
+// those go through selection, otherwise every key does.
+static void select_pair(const double *x, size_t count, size_t k, uint64_t pair[2]){
+	uint64_t *keys = NULL;
+	size_t size = count;
+	size_t offset = 0;
+	if (count >= SELECT_SAMPLE_MIN){
+		uint64_t *sample = malloc(SELECT_SAMPLE * sizeof(uint64_t));
+		size_t chunk_count = (count + SORT_CHUNK-1) / SORT_CHUNK;
+		size_t *counts = malloc(2 * chunk_count * sizeof(size_t));
+		if (sample == NULL || counts == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+		uint64_t state = 0x2545f4914f6cdd1dull;
+		for (size_t i=0; i!=SELECT_SAMPLE; i+=1) sample[i] = sort_key(x[select_random(&state) % count]);
+		radix_sort(sample, NULL, SELECT_SAMPLE);
+		size_t at = (size_t)((double)k / (double)count * SELECT_SAMPLE);
+		size_t margin = 4 * (size_t)sqrt((double)SELECT_SAMPLE);
+		SelectBand b = {x, count, 0, UINT64_MAX, counts, NULL};
+		if (at >= margin) b.lo = sample[at - margin];
+		if (at + margin + 1 < SELECT_SAMPLE) b.hi = sample[at + margin + 1];
+		free(sample);
+
+		parallel_for(chunk_count, select_count_task, &b);
+		size_t below = 0, inside = 0;
+		for (size_t i=0; i!=chunk_count; i+=1){
+			below += counts[2*i];
+			size_t n = counts[2*i + 1];
+			counts[2*i + 1] = inside;
+			inside += n;
+		}
+		if (below <= k && (k + 1 < below + inside || below + inside == count)){
+			keys = malloc((inside ? inside : 1) * sizeof(uint64_t));
+			if (keys == NULL){
+				fprintf(stderr, "ERROR: out of memory\n");
+				exit(1);
+			}
+			b.band = keys;
+			parallel_for(chunk_count, select_gather_task, &b);
+			size = inside;
+			offset = below;
+		}
+		free(counts);
+	}
+	if (keys == NULL){
+		keys = malloc(count * sizeof(uint64_t));
+		if (keys == NULL){
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+		sort_keys(keys, x, count);
+	}
+	select_key(keys, size, k - offset);
+	pair[0] = keys[k - offset];
+	pair[1] = pair[0];
+	if (k - offset + 1 < size){
+		pair[1] = keys[k - offset + 1];
+		for (size_t i=k-offset+2; i<size; i+=1) pair[1] = keys[i] < pair[1] ? keys[i] : pair[1];
+	}
+	free(keys);
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# decimal arithmetic with --decimal: exact sums, kept trailing zeros and
+# signs of zero, rounding modes, powers beyond the exponent range and integers
+# with more than 16 digits
+cd "$(dirname "$0")/.." || exit 1
+expected='= 0.3
+= 10.00
+= 3.30
+= 0.6666666666666667
+= -0.0
+= -0.0
+= 0.1111111111111111
+     ^
+ERROR: decimal overflow
+= 0E-398
+= 18446744073709551616.000000
+= 1.234567890123457E+19
+^
+ERROR: integer has more digits than a decimal
+= 0.6666666666666666
+= -0.3333333333333334'
+actual=$(printf '%s\n' \
+	'0.1 + 0.2' \
+	'2.50 * 4' \
+	'1.10 * 3' \
+	'2/3' \
+	'-0.0' \
+	'0.0 * -1' \
+	'3^-2' \
+	'(0.1)^-400' \
+	'10^-400' \
+	'2^64' \
+	'12345678901234567890.5' \
+	'123456789012345678901' | ./mathrepl --decimal 2>&1
+	echo '2/3' | ./mathrepl --decimal --rounding down 2>&1
+	echo '-1/3' | ./mathrepl --decimal --rounding floor 2>&1)
+if [ "$actual" != "$expected" ]; then
+	printf 'decimal: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
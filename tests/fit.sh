@@ -0,0 +1,15 @@
+#!/bin/sh
+# fits to a table with a row at x = 0, where sqrt(x) and x^0.5 have an
+# infinite derivative
+cd "$(dirname "$0")/.." || exit 1
+expected='= [3.000000]
+= [3.000000]
+= [3.000000, 0.500000]'
+actual=$(printf '%s\n' \
+	'fit(a*sqrt(x), a, "tests/sqrt.csv")' \
+	'fit(a*x^0.5, a, "tests/sqrt.csv")' \
+	'fit(a*x^b, a, b, "tests/sqrt.csv")' | ./mathrepl)
+if [ "$actual" != "$expected" ]; then
+	printf 'fit: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
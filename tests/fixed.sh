@@ -0,0 +1,28 @@
+#!/bin/sh
+# fixed point rounding, saturation and wrapping, which are the same bit for
+# bit on every platform
+cd "$(dirname "$0")/.." || exit 1
+expected='= fixed(0.99999999976716935634613037109375)
+= fixed(2147483647.99999999976716935634613037109375)
+= fixed(-2147483648.000000)
+= fixed(9.000000)
+= fixed(0.500000)
+= 0.250000
+        ^
+ERROR: divide by zero
+= fixed(2147483647.99999999976716935634613037109375)
+= fixed(-2147483648.000000)'
+actual=$(printf '%s\n' \
+	'fixed(1)/3*3' \
+	'fixed(0.5)^-40' \
+	'fixed(-0.5)^-41' \
+	'fixed(3)**2' \
+	'fixed(50)%' \
+	'real(fixed(1)/4)' \
+	'fixed(0)^-1' | ./mathrepl 2>&1; printf '%s\n' \
+	'fixed(2^31)' \
+	'fixed(0.5)^-31' | ./mathrepl --overflow wrap 2>&1)
+if [ "$actual" != "$expected" ]; then
+	printf 'fixed: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
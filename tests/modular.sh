@@ -0,0 +1,21 @@
+#!/bin/sh
+# modular arithmetic against residues computed independently, with moduli
+# up to 2^53 and factorials and binomials modulo a prime
+cd "$(dirname "$0")/.." || exit 1
+expected='= 246336683 (mod 1000000007)
+= 641102369 (mod 1000000007)
+= 3 (mod 7)
+= 9007199254740876 (mod 9007199254740881)
+= 996692777 (mod 1000000007)
+= 90548514656103281165404177077484163874504589675413336841320'
+actual=$(printf '%s\n' \
+	'mod(3, 1e9+7)^(10^18)' \
+	'mod(1e6, 1e9+7)!' \
+	'mod(2, 7)/mod(3, 7)' \
+	'mod(5, 2^53-111)*mod(-1, 2^53-111)' \
+	'nCrmod(10^6, 5*10^5, 1e9+7)' \
+	'nCr(200, 100)' | ./mathrepl)
+if [ "$actual" != "$expected" ]; then
+	printf 'modular: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
@@ -0,0 +1,20 @@
+#!/bin/sh
+# products and divisions long enough for the FFT, with coefficients whose
+# squares overflow a double
+cd "$(dirname "$0")/.." || exit 1
+expected='= [6.000000, -5.000000, -2.000000, 1.000000]
+= 1.000000
+= 1.000000
+= 3.000000'
+actual=$(printf '%s\n' \
+	'X = poly([0, 1])' \
+	'coeffs((X - 1)*(X + 2)*(X - 3))' \
+	'polyeval((X + 1)^1000, 1) / 2^1000' \
+	'b = 1e200*(X^10000 + 3*X^5000 + 2)' \
+	'a = (X^10000 + X + 1)*b + 1e200*X^3' \
+	'polyeval(polyrem(a, b), 1) / 1e200' \
+	'polyeval(polydiv(a, b), 1)' | ./mathrepl | grep -v '^= poly(')
+if [ "$actual" != "$expected" ]; then
+	printf 'poly: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
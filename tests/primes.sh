@@ -0,0 +1,21 @@
+#!/bin/sh
+# prime counts up to 20, where the primes up to 13 come from the presieved
+# pattern, and a few larger results of the number theory builtins
+cd "$(dirname "$0")/.." || exit 1
+expected='0 0 1 2 2 3 3 4 4 4 4 5 5 6 6 6 6 7 7 8 8
+= 5761455.000000
+= 1.000000
+= 1000000000039.000000
+= [71.000000, 839.000000, 1471.000000, 6857.000000]'
+counts=$(for n in $(seq 0 20); do echo "primepi($n)"; done | ./mathrepl | sed 's/^= \([0-9]*\)\..*/\1/' | tr '\n' ' ')
+actual=$(printf '%s\n' \
+	'primepi(1e8)' \
+	'isprime(2^53-111)' \
+	'nextprime(1e12)' \
+	'factor(600851475143)' | ./mathrepl)
+actual="${counts% }
+$actual"
+if [ "$actual" != "$expected" ]; then
+	printf 'primes: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
@@ -0,0 +1,26 @@
+#!/bin/sh
+# convolutions and cross-correlations short enough for the schoolbook product
+# and long enough for the FFT, tests/signal.csv has a column of values around
+# 1e200 and one around 1e-100. Sums and alternating sums of the results are
+# the products of those of the operands.
+cd "$(dirname "$0")/.." || exit 1
+expected='= [1.000000, 3.000000, 5.000000, 3.000000]
+= [2.000000, 5.000000, 8.000000, 3.000000]
+= 1.000000
+= 1.000000
+= 1.000000'
+actual=$(printf '%s\n' \
+	'conv([1, 2, 3], [1, 1])' \
+	'xcorr([1, 2, 3], [1, 2])' \
+	'a = column("tests/signal.csv", 1)' \
+	'b = column("tests/signal.csv", 2)' \
+	'A = poly(a)' \
+	'B = poly(b)' \
+	'polyeval(poly(conv(a, b)), 1) / (polyeval(A, 1)*polyeval(B, 1))' \
+	'polyeval(poly(conv(a, b)), -1) / (polyeval(A, -1)*polyeval(B, -1))' \
+	'polyeval(poly(xcorr(a, b)), 1) / (polyeval(A, 1)*polyeval(B, 1))' \
+	| ./mathrepl | grep -v 'elements\])\?$')
+if [ "$actual" != "$expected" ]; then
+	printf 'signal: expected\n%s\ngot\n%s\n' "$expected" "$actual"
+	exit 1
+fi
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <stdio.h>
+#include <math.h>
+
+#include "utils.h"
+
+// Physical units as the exponents of the seven SI base units, four signed bits
+// each, so that checking them costs an integer comparison. Quantities are kept
+// in base units, a unit written after a number is converted when the line is
+// tokenized and never again.
+
+#define UNIT_DIMENSIONS 7
+#define UNIT_BITS 4
+#define UNIT_MIN_EXPONENT -8
+#define UNIT_MAX_EXPONENT 7
+#define UNIT_NAME_CAPACITY 8
+
+typedef uint32_t Units;
+
+static const char *const unit_base_names[UNIT_DIMENSIONS] = {"kg", "m", "s", "A", "K", "mol", "cd"};
+
+typedef struct UnitName{
+	const char *name;
+	double factor;
+	int8_t exponents[UNIT_DIMENSIONS];
+} UnitName;
+
+//                                        kg  m   s   A   K mol cd
+static const UnitName unit_names[] = {
+	{"m",    1.0,                        { 0, 1, 0}},
+	{"km",   1e3,                        { 0, 1, 0}},
+	{"cm",   1e-2,                       { 0, 1, 0}},
+	{"mm",   1e-3,                       { 0, 1, 0}},
+	{"um",   1e-6,                       { 0, 1, 0}},
+	{"nm",   1e-9,                       { 0, 1, 0}},
+	{"in",   0.0254,                     { 0, 1, 0}},
+	{"ft",   0.3048,                     { 0, 1, 0}},
+	{"yd",   0.9144,                     { 0, 1, 0}},
+	{"mi",   1609.344,                   { 0, 1, 0}},
+	{"kg",   1.0,                        { 1, 0, 0}},
+	{"g",    1e-3,                       { 1, 0, 0}},
+	{"mg",   1e-6,                       { 1, 0, 0}},
+	{"t",    1e3,                        { 1, 0, 0}},
+	{"lb",   0.45359237,                 { 1, 0, 0}},
+	{"s",    1.0,                        { 0, 0, 1}},
+	{"ms",   1e-3,                       { 0, 0, 1}},
+	{"us",   1e-6,                       { 0, 0, 1}},
+	{"ns",   1e-9,                       { 0, 0, 1}},
+	{"min",  60.0,                       { 0, 0, 1}},
+	{"h",    3600.0,                     { 0, 0, 1}},
+	{"d",    86400.0,                    { 0, 0, 1}},
+	{"A",    1.0,                        { 0, 0, 0, 1}},
+	{"mA",   1e-3,                       { 0, 0, 0, 1}},
+	{"K",    1.0,                        { 0, 0, 0, 0, 1}},
+	{"mol",  1.0,                        { 0, 0, 0, 0, 0, 1}},
+	{"cd",   1.0,                        { 0, 0, 0, 0, 0, 0, 1}},
+	{"Hz",   1.0,                        { 0, 0,-1}},
+	{"kHz",  1e3,                        { 0, 0,-1}},
+	{"MHz",  1e6,                        { 0, 0,-1}},
+	{"GHz",  1e9,                        { 0, 0,-1}},
+	{"N",    1.0,                        { 1, 1,-2}},
+	{"kN",   1e3,                        { 1, 1,-2}},
+	{"Pa",   1.0,                        { 1,-1,-2}},
+	{"kPa",  1e3,                        { 1,-1,-2}},
+	{"MPa",  1e6,                        { 1,-1,-2}},
+	{"bar",  1e5,                        { 1,-1,-2}},
+	{"psi",  6894.757293168361,          { 1,-1,-2}},
+	{"J",    1.0,                        { 1, 2,-2}},
+	{"kJ",   1e3,                        { 1, 2,-2}},
+	{"MJ",   1e6,                        { 1, 2,-2}},
+	{"Wh",   3600.0,                     { 1, 2,-2}},
+	{"kWh",  3.6e6,                      { 1, 2,-2}},
+	{"eV",   1.602176634e-19,            { 1, 2,-2}},
+	{"cal",  4.184,                      { 1, 2,-2}},
+	{"kcal", 4184.0,                     { 1, 2,-2}},
+	{"W",    1.0,                        { 1, 2,-3}},
+	{"kW",   1e3,                        { 1, 2,-3}},
+	{"MW",   1e6,                        { 1, 2,-3}},
+	{"C",    1.0,                        { 0, 0, 1, 1}},
+	{"V",    1.0,                        { 1, 2,-3,-1}},
+	{"mV",   1e-3,                       { 1, 2,-3,-1}},
+	{"kV",   1e3,                        { 1, 2,-3,-1}},
+	{"ohm",  1.0,                        { 1, 2,-3,-2}},
+	{"F",    1.0,                        {-1,-2, 4, 2}},
+	{"T",    1.0,                        { 1, 0,-2,-1}},
+	{"L",    1e-3,                       { 0, 3, 0}},
+	{"mL",   1e-6,                       { 0, 3, 0}},
+};
+
+static int unit_exponent(Units u, size_t dim){
+	int e = (u >> (UNIT_BITS * dim)) & ((1 << UNIT_BITS) - 1);
+	return e >= (1 << (UNIT_BITS-1)) ? e - (1 << UNIT_BITS) : e;
+}
+
+// false when an exponent does not fit
+static bool units_pack(const int *exponents, Units *res){
+	*res = 0;
+	for (size_t d=0; d!=UNIT_DIMENSIONS; d+=1){
+		if (exponents[d] < UNIT_MIN_EXPONENT || exponents[d] > UNIT_MAX_EXPONENT) return false;
+		*res |= (Units)(exponents[d] & ((1 << UNIT_BITS) - 1)) << (UNIT_BITS * d);
+	}
+	return true;
+}
+
+// the units of a*b, or of a/b for a negative sign
+static bool units_multiply(Units a, Units b, int sign, Units *res){
+	int exponents[UNIT_DIMENSIONS];
+	for (size_t d=0; d!=UNIT_DIMENSIONS; d+=1) exponents[d] = unit_exponent(a, d) + sign*unit_exponent(b, d);
+	return units_pack(exponents, res);
+}
+
+// the units of a^e, every exponent has to stay an integer. Returns an error
+// message or NULL
+static const char *units_power(Units a, double e, Units *res){
+	int exponents[UNIT_DIMENSIONS];
+	for (size_t d=0; d!=UNIT_DIMENSIONS; d+=1){
+		double x = unit_exponent(a, d) * e;
+		if (x != floor(x)) return "power of units must be an integer";
+		if (!(fabs(x) <= 64.0)) return "unit power too large";
+		exponents[d] = (int)x;
+	}
+	return units_pack(exponents, res) ? NULL : "unit power too large";
+}
+
+static const UnitName *find_unit(const char *name, size_t size){
+	for (size_t i=0; i!=SIZE(unit_names); i+=1){
+		if (strlen(unit_names[i].name) == size && memcmp(unit_names[i].name, name, size) == 0) return unit_names + i;
+	}
+	return NULL;
+}
+
+// the unit name at it, if there is one
+static const UnitName *match_unit(const char *it, const char **end){
+	while (*it == ' ' || *it == '\t') it += 1;
+	const char *name = it;
+	while (('A' <= *it && *it <= 'Z') || ('a' <= *it && *it <= 'z')) it += 1;
+	if (it == name || it - name > UNIT_NAME_CAPACITY || ('0' <= *it && *it <= '9') || *it == '(') return NULL;
+	*end = it;
+	return find_unit(name, it - name);
+}
+
+// Reads units like "m/s^2" or "kg*m" after a number, each name may have an
+// integer power. An operator is only taken when a unit name follows it, so
+// "6 m / 2 s" is a length divided by a time. Returns an error message or NULL,
+// factor is 1 and units 0 when there is no unit.
+static const char *parse_units(const char **iter, double *factor, Units *units){
+	*factor = 1.0;
+	*units = 0;
+	const char *it = *iter;
+	int sign = 1;
+	for (;;){
+		const char *end;
+		const UnitName *unit = match_unit(it, &end);
+		if (unit == NULL) break;
+		it = end;
+		double power = 1.0;
+		if (*it == '^'){
+			char *number_end;
+			power = strtod(it + 1, &number_end);
+			if (number_end == it + 1 || power != floor(power)) return "unit power must be an integer";
+			it = number_end;
+		}
+		int exponents[UNIT_DIMENSIONS];
+		for (size_t d=0; d!=UNIT_DIMENSIONS; d+=1) exponents[d] = unit->exponents[d] * (int)power;
+		Units u;
+		if (!units_pack(exponents, &u) || !units_multiply(*units, u, sign, units)) return "unit power too large";
+		*factor = sign > 0 ? *factor * pow(unit->factor, power) : *factor / pow(unit->factor, power);
+		*iter = it;
+
+		const char *op = it;
+		while (*op == ' ' || *op == '\t') op += 1;
+		if (*op != '*' && *op != '/') break;
+		if (match_unit(op + 1, &end) == NULL) break;
+		sign = *op == '*' ? 1 : -1;
+		it = op + 1;
+	}
+	return NULL;
+}
+
+// as they can be read back, " kg*m/s^2"
+static void print_units(Units units){
+	bool numerator = true;
+	for (size_t d=0; d!=UNIT_DIMENSIONS; d+=1){
+		int e = unit_exponent(units, d);
+		if (e <= 0) continue;
+		printf("%c%s", numerator ? ' ' : '*', unit_base_names[d]);
+		if (e != 1) printf("^%d", e);
+		numerator = false;
+	}
+	for (size_t d=0; d!=UNIT_DIMENSIONS; d+=1){
+		int e = unit_exponent(units, d);
+		if (e >= 0) continue;
+		if (numerator) printf(" 1");
+		printf("/%s", unit_base_names[d]);
+		if (e != -1) printf("^%d", -e);
+		numerator = false;
+	}
+}
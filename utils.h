@@ -7,3 +7,12 @@
 #include <assert.h>
 
 #define SIZE(arr) (sizeof(arr)/sizeof(*arr))
+
+static inline uint64_t hash_name(const char *name, size_t size, uint64_t seed){
+	uint64_t hash = 14695981039346656037ull ^ seed;
+	for (size_t i=0; i!=size; i+=1) hash = (hash ^ (uint8_t)name[i]) * 1099511628211ull;
+	hash ^= hash >> 32;
+	hash *= 0xd6e8feb86659fd93ull;
+	hash ^= hash >> 32;
+	return hash;
+}